@@ -6,6 +6,7 @@
 
 
 #include "firefly-display.h"
+#include "firefly-image.h"
 
 #include "logo.h"
 
@@ -19,27 +20,28 @@ static void delay(uint32_t duration) {
   vTaskDelay((duration + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS);
 }
 
-// Copy the logo.h onto the display
-void renderFunc(uint8_t *buffer, uint32_t y0, void *context) {
-  uint8_t *dst = &buffer[0];
-  for (int y = y0; y < MIN(logo_height, y0 + FfxDisplayFragmentHeight); y++) {
-    const uint8_t *src = &logo[y * logo_width * 2];
-    for (int x = 0; x < MIN(logo_width, FfxDisplayFragmentWidth); x++) {
-      *dst++ = *src++;
-      *dst++ = *src++;
-    }
-  }
+// Decode the rows of logo.h (a compressed image asset, generated from
+// logo.png by tools/ffx-asset) for this fragment onto the display
+void renderFunc(uint16_t *pixels, uint32_t y0, void *context) {
+  FfxImage *image = context;
+  ffx_image_decodeRows(image, y0, FfxDisplayFragmentHeight, pixels,
+    FfxDisplayFragmentWidth);
 }
 
 void app_main(void) {
-  FfxDisplayContext display = ffx_display_init(DISPLAY_BUS, PIN_DISPLAY_DC,
-    PIN_DISPLAY_RESET, FfxDisplayRotationRibbonRight, renderFunc, NULL);
-
-  while (1) {
-    uint32_t frameDone = ffx_display_renderFragment(display);
-    if (frameDone) {
-      printf("done!\n");
-      while(1) { delay(1000); }
-    }
+  static FfxImage image;
+  if (!ffx_image_init(&image, logo, logo_length)) {
+    printf("bad logo asset\n");
+    return;
   }
+
+  FfxDisplayContext display = ffx_display_init(DISPLAY_BUS, PIN_DISPLAY_DC,
+    PIN_DISPLAY_RESET, FfxDisplayRotationRibbonRight, renderFunc, &image);
+
+  FfxDisplayFrameInfo info;
+  ffx_display_renderFrame(display, &info);
+  printf("done! (%d fragments in %d us)\n", (int)info.fragments,
+    (int)(info.sentTime - info.startTime));
+
+  while(1) { delay(1000); }
 }
@@ -0,0 +1,103 @@
+#ifndef __FIREFLY_ASSETS_H__
+#define __FIREFLY_ASSETS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "firefly-image.h"
+
+
+/**
+ *  Asset Bundle Format
+ *
+ *  A bundle is a directory of named assets, usually written to a
+ *  dedicated data partition so assets are not part of the app image.
+ *  All fields are little-endian.
+ *
+ *    0   "FFXB"           - magic
+ *    4   uint8            - version (1)
+ *    5   uint8            - reserved (0)
+ *    6   uint16           - entry count
+ *    8   uint32           - total bundle length
+ *    12  uint32           - reserved (0)
+ *    16  entries[count]   - sorted by name
+ *
+ *  Each entry (32 bytes):
+ *    0   char[24]         - name (NUL padded; at most 23 characters)
+ *    24  uint32           - offset of the asset from the bundle start
+ *    28  uint32           - length of the asset
+ *
+ *  Asset offsets are 4-byte aligned.
+ */
+#define FFX_ASSETS_MAGIC          ("FFXB")
+#define FFX_ASSETS_VERSION        (1)
+#define FFX_ASSETS_HEADER_SIZE    (16)
+#define FFX_ASSETS_ENTRY_SIZE     (32)
+#define FFX_ASSETS_NAME_LENGTH    (24)
+
+/**
+ *  Asset Bundle Object.
+ *
+ *  This is intentionally opaque; do not inspect or rely on internals.
+ */
+typedef void* FfxAssets;
+
+/**
+ *  Maps an asset bundle into memory.
+ *
+ *  On ESP-IDF %%source%% is the label of a data partition, which is
+ *  mapped with esp_partition_mmap so assets are read directly from
+ *  flash (through the cache) with no copies. On a host, %%source%% is
+ *  the path of a bundle file, which is mapped with mmap.
+ *
+ *  Returns NULL if the source cannot be mapped or is not a valid bundle.
+ */
+FfxAssets ffx_assets_open(const char *source);
+
+/**
+ *  Unmaps the bundle. Any pointers returned by the find functions
+ *  must not be used after this.
+ */
+void ffx_assets_close(FfxAssets assets);
+
+/**
+ *  Returns the number of assets in the bundle.
+ */
+uint32_t ffx_assets_count(FfxAssets assets);
+
+/**
+ *  Returns the name of the asset at %%index%% (in sorted order), or
+ *  NULL if out of range. The name is only valid while the bundle is
+ *  open.
+ */
+const char* ffx_assets_name(FfxAssets assets, uint32_t index);
+
+/**
+ *  Looks up an asset by %%name%%, returning a pointer to the asset in
+ *  the mapped bundle (or NULL if not found) and setting %%length%% (if
+ *  non-NULL) to its length.
+ */
+const uint8_t* ffx_assets_find(FfxAssets assets, const char *name,
+  size_t *length);
+
+/**
+ *  Looks up an image asset by %%name%% and parses it into %%image%%,
+ *  which then decodes directly from the mapped bundle.
+ *
+ *  Returns false if not found or not a valid image asset.
+ */
+bool ffx_assets_findImage(FfxAssets assets, const char *name,
+  FfxImage *image);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FIREFLY_ASSETS_H__ */
@@ -6,11 +6,15 @@ extern "C" {
 #endif /* __cplusplus */
 
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include <driver/spi_master.h>
 #include <soc/spi_pins.h>
 
+#include "firefly-image.h"
+
 //#define DEBUG_SHOW_FPS  (1)
 
 
@@ -89,7 +93,7 @@ typedef enum FfxDisplaySpiBus {
     ),
     FfxDisplaySpiBus2oct_nocs = _ENCODE_SPI_BUS(
         SPI2_HOST,
-        SPI2_IOMUX_PIN_NUM_CS_OCT,
+        0,
         SPI2_IOMUX_PIN_NUM_CLK_OCT,
         SPI2_IOMUX_PIN_NUM_MISO_OCT,
         SPI2_IOMUX_PIN_NUM_MOSI_OCT
@@ -123,33 +127,278 @@ typedef enum FfxDisplaySpiBus {
 /**
  *  The side of the display the ribbon is protruding from, used
  *  to specify display rotation.
+ *
+ *  Any rotation may be OR-ed with FfxDisplayRotationMirror to mirror
+ *  the image horizontally (a vertical mirror is a horizontal mirror
+ *  of the opposite rotation). Rotation and mirroring are performed by
+ *  the display controller, so the render callback never needs to.
  */
 typedef enum FfxDisplayRotation {
-    FfxDisplayRotationRibbonBottom,
-    FfxDisplayRotationRibbonRight
+    FfxDisplayRotationRibbonBottom  = 0,
+    FfxDisplayRotationRibbonRight   = 1,
+    FfxDisplayRotationRibbonTop     = 2,
+    FfxDisplayRotationRibbonLeft    = 3,
+
+    FfxDisplayRotationMirror        = (1 << 4),
 } FfxDisplayRotation;
 
 /**
- *  The Fragment dimensions.
+ *  MADCTL (Memory Data Access Control) bits, which are common to the
+ *  supported controllers.
+ */
+#define FFX_DISPLAY_MADCTL_MY     (1 << 7)   // Row address order
+#define FFX_DISPLAY_MADCTL_MX     (1 << 6)   // Column address order
+#define FFX_DISPLAY_MADCTL_MV     (1 << 5)   // Row/column exchange
+#define FFX_DISPLAY_MADCTL_BGR    (1 << 3)   // BGR (vs. RGB) order
+
+/**
+ *  Initialization Sequences
+ *
+ *  A sequence is a list of commands, each the command byte, the
+ *  parameter count and the parameters, terminated by
+ *  FFX_DISPLAY_INIT_DONE. The pseudo-commands take one parameter:
+ *   - FFX_DISPLAY_INIT_WAIT: pause for the parameter (in ms)
+ *   - FFX_DISPLAY_INIT_RESET: set the reset pin to the parameter
+ *   - FFX_DISPLAY_INIT_ESCAPE: send the parameter as a command (for
+ *     controller commands which collide with the pseudo-commands),
+ *     followed by its parameter count and parameters
+ */
+#define FFX_DISPLAY_INIT_ESCAPE   (0xfc)
+#define FFX_DISPLAY_INIT_DONE     (0xfd)
+#define FFX_DISPLAY_INIT_RESET    (0xfe)
+#define FFX_DISPLAY_INIT_WAIT     (0xff)
+
+/**
+ *  Display Controller
+ *
+ *  Describes a display controller (driver IC), so the fragment engine
+ *  can be shared by any MIPI DCS-style controller with a 16-bit RGB565
+ *  serial interface.
+ */
+typedef struct FfxDisplayController {
+    // The frame memory size, in the native orientation
+    uint16_t gramWidth;
+    uint16_t gramHeight;
+
+    // The initialization sequence (see above); the parameters of the
+    // MADCTL and column window commands in it are computed from the
+    // rotation and panel offsets
+    const uint8_t *initSequence;
+
+    // The window (column and row address) and memory write commands
+    uint8_t commandCASET;
+    uint8_t commandRASET;
+    uint8_t commandRAMWR;
+    uint8_t commandMADCTL;
+
+    // XOR-ed into the MADCTL for every rotation (e.g. the BGR bit and
+    // any mirroring for the native orientation)
+    uint8_t madctl;
+
+    // MADCTL bits the controller is configured to invert itself (e.g.
+    // by the ST7789 LCMCTRL), which affect the frame memory offsets
+    uint8_t madctlInverted;
+
+    // Optional; encodes the parameters of the frame rate command for
+    // the fastest refresh rate which is at most hz (or the slowest the
+    // controller supports), returning that rate
+    uint8_t commandFrameRate;
+    uint16_t (*frameRate)(uint16_t hz, uint8_t *params, uint8_t *paramCount);
+
+    // The SPI clock, for initialization and fragment data
+    int clockSpeed;
+} FfxDisplayController;
+
+extern const FfxDisplayController FfxDisplayControllerST7789;
+extern const FfxDisplayController FfxDisplayControllerILI9341;
+extern const FfxDisplayController FfxDisplayControllerGC9A01;
+extern const FfxDisplayController FfxDisplayControllerST7735;
+
+/**
+ *  Panel Descriptor
+ *
+ *  Describes the controller and geometry of a panel in its native
+ *  (i.e. FfxDisplayRotationRibbonBottom) orientation. The frame memory
+ *  may be larger than the panel (e.g. the ST7789 frame memory is
+ *  240x320), in which case the panel shows a window of it, at offsets
+ *  which depend on how the glass is bonded to the controller (see the
+ *  panel datasheet or vendor sample code).
+ *
+ *  The fragment engine, transaction sizes and SPI transfer limits are
+ *  all derived from the panel.
+ */
+typedef struct FfxDisplayPanel {
+    // The controller (NULL for the ST7789)
+    const FfxDisplayController *controller;
+
+    // The visible size
+    uint16_t width;
+    uint16_t height;
+
+    // The position of the visible region within the frame memory
+    uint16_t columnOffset;
+    uint16_t rowOffset;
+
+    // XOR-ed into the MADCTL for every rotation (e.g. the RGB bit for
+    // a BGR panel, or MX for glass bonded mirrored)
+    uint8_t madctl;
+
+    // The rows per fragment (0 for the default of 24); taller fragments
+    // use more DMA memory but fewer transactions per frame
+    uint8_t fragmentHeight;
+
+    // Optional; a sequence (see Initialization Sequences) sent after
+    // the controller initialization sequence, to override its settings
+    // (e.g. gamma, VCOM or inversion)
+    const uint8_t *initOverrides;
+} FfxDisplayPanel;
+
+/**
+ *  Common panels (those without a controller prefix are ST7789).
+ */
+extern const FfxDisplayPanel FfxDisplayPanel240x240;
+extern const FfxDisplayPanel FfxDisplayPanel240x320;
+extern const FfxDisplayPanel FfxDisplayPanel135x240;
+extern const FfxDisplayPanel FfxDisplayPanel172x320;
+extern const FfxDisplayPanel FfxDisplayPanelILI9341_240x320;
+extern const FfxDisplayPanel FfxDisplayPanelGC9A01_240x240;
+extern const FfxDisplayPanel FfxDisplayPanelST7735_128x160;
+
+/**
+ *  The Fragment dimensions, for the default (240x240) panel. For other
+ *  panels use ffx_display_width and ffx_display_fragmentHeight.
  */
 extern const uint8_t FfxDisplayFragmentHeight;
 extern const uint8_t FfxDisplayFragmentWidth;
 
 /**
- *  The number of fragments per screen.
+ *  The number of fragments per screen, for the default (240x240) panel.
+ *  For other panels use ffx_display_fragmentCount.
  */
 extern const uint8_t FfxDisplayFragmentCount;
 
+/**
+ *  Pixel Format
+ *
+ *  Each fragment pixel is a `uint16_t` RGB565 value, stored in the
+ *  order the panel consumes it. The serial interface shifts every
+ *  16-bit pixel out MSB first, so on the (little-endian) ESP32 family
+ *  a pixel value is the byte-swapped native RGB565 value.
+ *
+ *  Use FFX_RGB565 (8-bit components) or FFX_PIXEL (a native RGB565
+ *  value) to build pixels; both are constant expressions, so can be
+ *  used in static tables, and the results can be written with plain
+ *  16-bit (or paired 32-bit) stores.
+ */
+#define FFX_PIXEL(native)   ((uint16_t)((((native) & 0xff) << 8) | (((native) >> 8) & 0xff)))
+
+#define FFX_RGB565(r,g,b)   FFX_PIXEL((((r) & 0xf8) << 8) | (((g) & 0xfc) << 3) | (((b) & 0xff) >> 3))
+
+/**
+ *  Fills %%count%% pixels with %%color%% (already in pixel order; see
+ *  FFX_RGB565), using 32-bit stores where possible.
+ */
+static inline void ffx_display_fillPixels(uint16_t *pixels, uint16_t color,
+  size_t count) {
+
+    if (count && ((uintptr_t)pixels & 2)) {
+        *pixels++ = color;
+        count--;
+    }
+
+    uint32_t pair = ((uint32_t)color << 16) | color;
+    uint32_t *words = (uint32_t*)pixels;
+    for (size_t i = count / 2; i; i--) { *words++ = pair; }
+
+    if (count & 1) { pixels[count - 1] = color; }
+}
+
+/**
+ *  Copies %%count%% pixels from %%src%% to %%dst%%, using 32-bit
+ *  loads and stores when both are equally aligned.
+ *
+ *  By default %%src%% must already be in pixel order (e.g. an image
+ *  asset stored MSB first). Define FFX_DISPLAY_SWAP_SOURCE (with any
+ *  value, or none) before including this header (or as a compile
+ *  definition) if sources hold native RGB565 values instead, and each
+ *  pixel is byte-swapped during the copy at no extra memory traffic.
+ */
+static inline void ffx_display_copyPixels(uint16_t *dst, const uint16_t *src,
+  size_t count) {
+
+#if defined(FFX_DISPLAY_SWAP_SOURCE)
+    #define _FFX_SWAP_PAIR(w)  ((((w) & 0x00ff00ff) << 8) | (((w) >> 8) & 0x00ff00ff))
+#else
+    #define _FFX_SWAP_PAIR(w)  (w)
+#endif
+
+    if (((uintptr_t)dst & 2) == ((uintptr_t)src & 2)) {
+        if (count && ((uintptr_t)dst & 2)) {
+            *dst++ = _FFX_SWAP_PAIR(*src);
+            src++;
+            count--;
+        }
+
+        uint32_t *dstWords = (uint32_t*)dst;
+        const uint32_t *srcWords = (const uint32_t*)src;
+        for (size_t i = count / 2; i; i--) {
+            uint32_t pair = *srcWords++;
+            *dstWords++ = _FFX_SWAP_PAIR(pair);
+        }
+
+        if (count & 1) { dst[count - 1] = _FFX_SWAP_PAIR(src[count - 1]); }
+
+    } else {
+        for (size_t i = 0; i < count; i++) { dst[i] = _FFX_SWAP_PAIR(src[i]); }
+    }
+
+    #undef _FFX_SWAP_PAIR
+}
+
 /**
  *  The callback function called per fragment to render to the buffer.
  *
- *  When called the buffer should be updated with RGB565 colors (2 bytes)
- *  per pixel, starting at the source line y0 (0 is the top line)
- *  populating DisplayFragmentWidth wide and DisplayFragmentHeight high.
+ *  When called %%pixels%% should be populated with RGB565 pixels (see
+ *  Pixel Format above), starting at the source line y0 (0 is the top
+ *  line) populating ffx_display_width wide and
+ *  ffx_display_fragmentHeight high (FfxDisplayFragmentWidth and
+ *  FfxDisplayFragmentHeight for the default panel). The buffer is
+ *  4-byte aligned, as is each row if the width is even (rows of an odd
+ *  width display, such as the 135x240 panel, alternate).
+ *
+ *  If the display height is not a multiple of the fragment height,
+ *  the rows of the last fragment past the bottom are not sent.
  *
  *  The %%context%% is what was provided to the init call.
  */
-typedef void (*FfxRenderFunc)(uint8_t *buffer, uint32_t y0, void *context);
+typedef void (*FfxRenderFunc)(uint16_t *pixels, uint32_t y0, void *context);
+
+/**
+ *  Renders a sub-rectangle of a fragment (see ffx_display_setParallelRender).
+ *
+ *  The rectangle is %%width%% x %%height%% pixels at (%%x0%%, %%y0%%) of
+ *  the display; %%pixels%% is its top-left pixel, and each row begins
+ *  %%stride%% pixels after the previous one. Rows (including the first
+ *  row of the second rectangle) only start 4-byte aligned if %%stride%%
+ *  is even, which it is not for an odd display width.
+ *
+ *  The rectangles of the last fragment are clipped to the display
+ *  height, so never extend past the bottom.
+ */
+typedef void (*FfxRenderRectFunc)(uint16_t *pixels, uint32_t stride,
+  uint32_t x0, uint32_t y0, uint32_t width, uint32_t height, void *context);
+
+/**
+ *  How a fragment is split for parallel rendering.
+ */
+typedef enum FfxDisplaySplit {
+    // The top and bottom halves of the rows
+    FfxDisplaySplitRows = 0,
+
+    // The left and right halves of the columns (for fragments with few
+    // rows, or content which varies across them)
+    FfxDisplaySplitColumns
+} FfxDisplaySplit;
 
 /**
  *  Display Context Object.
@@ -163,15 +412,76 @@ typedef void* FfxDisplayContext;
  *  configure the screen, blocking the current thread until
  *  complete.
  *
+ *  Several displays may share a SPI host, if each has its own CS pin
+ *  (i.e. not a `_nocs` bus) and D/C pin. They share one pair of
+ *  fragment buffers (sized for the largest display), so must all be
+ *  rendered from the same task (see ffx_display_renderFragments). The
+ *  bus transfer limit is set by the first display on it, so initialize
+ *  the display with the largest fragments first.
+ *
  *  This allocates DMA-compatible RAM and returns NULL if the
- *  memory cannot be allocated.
+ *  memory cannot be allocated or the bus cannot be shared.
  */
 FfxDisplayContext ffx_display_init(FfxDisplaySpiBus spiBus, uint8_t pinDC,
     uint8_t pinReset, FfxDisplayRotation rotation,
     FfxRenderFunc renderFunc, void *ctx);
 
 /**
- *  Release all allocated buffers.
+ *  Declares the transfer limit (the max_transfer_sz) of a SPI bus which
+ *  is initialized by another component (e.g. an SD card), before the
+ *  first display on it is initialized. Without it, the ESP-IDF default
+ *  of 4092 bytes is assumed, which is less than a fragment of most
+ *  panels. A display whose fragments (plus 8 bytes) exceed the limit
+ *  cannot use the bus.
+ */
+void ffx_display_setSpiBusLimit(FfxDisplaySpiBus spiBus, size_t maxTransfer);
+
+/**
+ *  Initializes a display with the geometry of %%panel%%, which is
+ *  copied. The ffx_display_init function uses FfxDisplayPanel240x240.
+ *
+ *  Returns NULL if the panel does not fit in the frame memory or the
+ *  memory cannot be allocated.
+ */
+FfxDisplayContext ffx_display_initPanel(FfxDisplaySpiBus spiBus,
+    uint8_t pinDC, uint8_t pinReset, const FfxDisplayPanel *panel,
+    FfxDisplayRotation rotation, FfxRenderFunc renderFunc, void *ctx);
+
+/**
+ *  Called once an asynchronous initialization is complete.
+ */
+typedef void (*FfxDisplayReadyFunc)(FfxDisplayContext context, void *arg);
+
+/**
+ *  Initializes a display like ffx_display_initPanel, but returns
+ *  immediately, running the reset and initialization sequence in a
+ *  background task, so other startup work (e.g. Wi-Fi or storage) can
+ *  overlap the panel bring-up.
+ *
+ *  If %%splash%% is non-NULL, it is drawn centered on a black
+ *  background as soon as the panel is on. The image is copied, but the
+ *  asset data must remain valid until the display is ready.
+ *
+ *  Once complete, %%readyFunc%% (if non-NULL) is called from the
+ *  background task. Until then, rendering and panel commands block
+ *  (see ffx_display_isReady), and no other display on the same bus may
+ *  be rendered. Initializing another display on the same bus blocks
+ *  until this one is ready, since the init task uses the shared
+ *  fragments.
+ */
+FfxDisplayContext ffx_display_initAsync(FfxDisplaySpiBus spiBus,
+    uint8_t pinDC, uint8_t pinReset, const FfxDisplayPanel *panel,
+    FfxDisplayRotation rotation, FfxRenderFunc renderFunc, void *ctx,
+    const FfxImage *splash, FfxDisplayReadyFunc readyFunc, void *readyArg);
+
+/**
+ *  Returns true once the display is initialized.
+ */
+bool ffx_display_isReady(FfxDisplayContext context);
+
+/**
+ *  Release all allocated buffers (the shared fragment buffers and the
+ *  SPI bus are released with the last display on the bus).
  *
  *  The DisplayContext must not be used after calling this
  *  without calling init again first.
@@ -187,11 +497,649 @@ void ffx_display_free(FfxDisplayContext context);
  */
 uint32_t ffx_display_renderFragment(FfxDisplayContext context);
 
+/**
+ *  Presentation details of a frame (see ffx_display_renderFrame).
+ */
+typedef struct FfxDisplayFrameInfo {
+    // The number of frames completed, including this one
+    uint32_t frame;
+
+    // The fragments rendered and sent
+    uint32_t fragments;
+
+    // When the frame started (see ffx_display_frameTime) and when its
+    // last fragment was on the panel (in microseconds; see
+    // ffx_display_presentTime)
+    int64_t startTime;
+    int64_t sentTime;
+
+    // The time spent in the render function (in microseconds)
+    uint32_t renderTime;
+} FfxDisplayFrameInfo;
+
+/**
+ *  Renders and sends a whole frame, replacing a loop around
+ *  ffx_display_renderFragment, and returns once its last fragment is on
+ *  the panel, filling in %%info%% (if non-NULL). Returns the number of
+ *  frames completed.
+ *
+ *  Each fragment is rendered while the previous one is on the wire,
+ *  frame pacing and the frame hooks (see ffx_display_setFrameBegin and
+ *  ffx_display_setFrameEnd) are applied, and the SPI bus is held for
+ *  the whole frame if no other display shares it.
+ */
+uint32_t ffx_display_renderFrame(FfxDisplayContext context,
+  FfxDisplayFrameInfo *info);
+
+/**
+ *  The result of ffx_display_submitFragment.
+ */
+typedef enum FfxDisplayStatus {
+    // Both fragment buffers are in use; poll and try again later
+    FfxDisplayStatusWouldBlock = 0,
+
+    // The fragment was rendered and sent (or will be once the fragment
+    // on the wire completes)
+    FfxDisplayStatusSubmitted,
+
+    // As above, and it was the last fragment of the frame
+    FfxDisplayStatusFrameDone
+} FfxDisplayStatus;
+
+/**
+ *  Renders and sends the next fragment like ffx_display_renderFragment,
+ *  but never waits for the SPI bus, so the driver can be run from an
+ *  event loop or cooperative scheduler alongside other work.
+ *
+ *  The fragment is rendered into the free fragment buffer; if the
+ *  previous fragment is still on the wire, it is sent by a later call
+ *  to ffx_display_pollFragment (or ffx_display_submitFragment), until
+ *  which no buffer is free and FfxDisplayStatusWouldBlock is returned.
+ *  Also returns FfxDisplayStatusWouldBlock until the display is ready.
+ *
+ *  The commands sent at the end of a frame (for page flipping or an
+ *  adaptive refresh rate), and the end of the first frame (for the
+ *  startup statistics) still wait for the bus.
+ */
+FfxDisplayStatus ffx_display_submitFragment(FfxDisplayContext context);
+
+/**
+ *  Advances submitted fragments without blocking, retiring the
+ *  fragment on the wire if it is complete and sending the next one.
+ *
+ *  Returns true once the bus is idle (all fragments are complete).
+ */
+bool ffx_display_pollFragment(FfxDisplayContext context);
+
+/**
+ *  Called as the last data of a fragment starting at %%y0%% is sent.
+ *
+ *  This is called from the SPI interrupt, so must be short and only
+ *  use ISR-safe functions (e.g. to notify a task that the driver can
+ *  make progress); it must be in IRAM (IRAM_ATTR).
+ */
+typedef void (*FfxDisplayFragmentFunc)(FfxDisplayContext context,
+  uint32_t y0, void *arg);
+
+/**
+ *  Sets the callback for completed fragments of the display (or NULL).
+ *  Mirrors have their own callbacks.
+ */
+void ffx_display_setFragmentCallback(FfxDisplayContext context,
+  FfxDisplayFragmentFunc fragmentFunc, void *arg);
+
+/**
+ *  Returns when the data of the fragment starting at %%y0%% (as passed
+ *  to the render function) last completed, so its pixels were in the
+ *  frame memory (in microseconds, from esp_timer_get_time), or 0 if it
+ *  has never been sent. The time is captured in the SPI interrupt, so
+ *  it can also be read from a fragment callback.
+ */
+int64_t ffx_display_fragmentTime(FfxDisplayContext context, uint32_t y0);
+
+/**
+ *  Returns when the most recently completed frame was presented (its
+ *  last fragment sent was in the frame memory), setting %%frame%% (if
+ *  non-NULL) to its number (see FfxDisplayFrameInfo).
+ *
+ *  Returns 0 if its last fragment is still on the wire (e.g. with
+ *  ffx_display_submitFragment) or no frame has completed. A frame with
+ *  no fragments sent (see ffx_display_setRefreshDivisor) was presented
+ *  when it started.
+ *
+ *  The panel shows the frame memory from its next refresh, so for
+ *  input-to-photon latency add up to a refresh period.
+ */
+int64_t ffx_display_presentTime(FfxDisplayContext context, uint32_t *frame);
+
+/**
+ *  Renders and sends only the rows from %%y0%% to %%y0 + height%%,
+ *  blocking until the last fragment is on the wire. The [[RenderFunc]]
+ *  is called for each fragment of the rows, starting at %%y0%%; only
+ *  the requested rows are sent.
+ *
+ *  Use this between frames (i.e. not while a frame is partially sent
+ *  by ffx_display_renderFragment), e.g. after ffx_display_scroll.
+ */
+void ffx_display_renderRows(FfxDisplayContext context, uint32_t y0,
+  uint32_t height);
+
+/**
+ *  Scrolls the content up by %%rows%% (down if negative) using the
+ *  controller's hardware vertical scrolling, so only the newly exposed
+ *  rows need to be rendered and sent:
+ *
+ *    ffx_display_scroll(display, 8);
+ *    ffx_display_renderRows(display, ffx_display_height(display) - 8, 8);
+ *
+ *  The rows passed to the [[RenderFunc]] remain screen rows; the driver
+ *  maps them to the scrolled frame memory. Any mirrors are scrolled
+ *  too.
+ *
+ *  Returns false if the rotation exchanges rows and columns (i.e. the
+ *  RibbonRight and RibbonLeft rotations), as the controller can only
+ *  scroll along the frame memory rows, or if page flipping is enabled.
+ */
+bool ffx_display_scroll(FfxDisplayContext context, int32_t rows);
+
+/**
+ *  Enables page flipping for a band of %%height%% rows, using frame
+ *  memory rows the panel does not show (e.g. the 80 rows a 240x240
+ *  panel leaves unused on an ST7789) as a hidden page.
+ *
+ *  The rows of the band are always written to the hidden page, which
+ *  is revealed at once (using the vertical scroll start address) after
+ *  the last fragment of each frame or by ffx_display_flip, so animated
+ *  content in the band never tears, without a framebuffer.
+ *
+ *  The band is at the top or bottom of the screen, depending on where
+ *  the unused rows are and the rotation; returns its first row, or -1
+ *  if there are not enough unused rows, the rotation exchanges rows
+ *  and columns, the content is scrolled or the band of any mirror
+ *  would cover other rows. Until the first flip, the band shows the
+ *  previous content.
+ */
+int32_t ffx_display_enablePageFlip(FfxDisplayContext context,
+  uint32_t height);
+
+/**
+ *  Disables page flipping. The band may show an older page, so should
+ *  be rendered again.
+ */
+void ffx_display_disablePageFlip(FfxDisplayContext context);
+
+/**
+ *  Renders the band to the hidden page and reveals it:
+ *
+ *    int32_t bandY = ffx_display_enablePageFlip(display, 80);
+ *    while (1) { ffx_display_flip(display); }
+ *
+ *  Use this between frames, like ffx_display_renderRows.
+ */
+void ffx_display_flip(FfxDisplayContext context);
+
+/**
+ *  Switches the panel into partial mode, so only the rows from %%y0%%
+ *  to %%y0 + height%% are displayed and the rest of the panel is blank
+ *  (e.g. a watch face). Frames from ffx_display_renderFragment then
+ *  only cover those rows, so the fragment engine renders and sends
+ *  fewer fragments; the first fragment of a frame starts at %%y0%%.
+ *
+ *  Any mirrors are switched too. Use this between frames.
+ *
+ *  Returns false if the rows are not on the display, the rotation
+ *  exchanges rows and columns, or the content is scrolled or page
+ *  flipped (which cannot be used in partial mode).
+ */
+bool ffx_display_enablePartial(FfxDisplayContext context, uint32_t y0,
+  uint32_t height);
+
+/**
+ *  Switches the panel back to normal mode, where frames cover all the
+ *  rows. The rows outside the partial area should be rendered again.
+ */
+void ffx_display_disablePartial(FfxDisplayContext context);
+
+/**
+ *  Renders the next fragment of each of %%displays%% in turn, so the
+ *  fragments of displays sharing a bus are interleaved and each is
+ *  rendered while the previous display's fragment is on the wire.
+ *
+ *  Returns a bitmask of the displays (by index; at most 32) for which
+ *  the last fragment of the frame was rendered.
+ */
+uint32_t ffx_display_renderFragments(FfxDisplayContext *displays,
+  size_t count);
+
+/**
+ *  Mirrors the display onto %%mirror%%: each fragment is rendered once
+ *  and the same DMA buffer is sent to the display and every mirror, so
+ *  the render cost does not grow with mirrors. Mirrors on other SPI
+ *  hosts are sent in parallel.
+ *
+ *  The mirror must have the same size (after rotation) and fragment
+ *  height; its own rotation (and panel offsets) are applied by its
+ *  controller, so it may be mounted differently. While attached, the
+ *  mirror must not be rendered itself.
+ *
+ *  Returns false if the geometry differs, or either display is already
+ *  a mirror.
+ */
+bool ffx_display_addMirror(FfxDisplayContext context, FfxDisplayContext mirror);
+
+/**
+ *  Detaches %%mirror%%, which may then be rendered independently.
+ */
+void ffx_display_removeMirror(FfxDisplayContext context,
+  FfxDisplayContext mirror);
+
+/**
+ *  Sets the panel's internal refresh rate to the fastest rate which is
+ *  at most %%hz%% (or the slowest the controller supports), returning
+ *  that rate, or 0 if the controller cannot change its refresh rate.
+ *  Any mirrors are set too. This disables an adaptive refresh rate.
+ *
+ *  A panel refreshing faster than frames are produced only uses power;
+ *  a panel refreshing slower than frames are produced drops them.
+ */
+uint16_t ffx_display_setFrameRate(FfxDisplayContext context, uint16_t hz);
+
+/**
+ *  Adapts the panel's internal refresh rate to the content: while
+ *  frames are completed in quick succession (an animation) the panel
+ *  refreshes at %%maxHz%%, and once they stop (e.g. a static image is
+ *  shown) it drops to %%minHz%%.
+ *
+ *  The rate is raised as a frame completes; as no frames complete while
+ *  the content is static, call ffx_display_updateFrameRate periodically
+ *  while idle to lower it.
+ *
+ *  Returns false if the controller cannot change its refresh rate.
+ */
+bool ffx_display_setAdaptiveFrameRate(FfxDisplayContext context,
+  uint16_t minHz, uint16_t maxHz);
+
+/**
+ *  Lowers an adaptive refresh rate if no frames have been completed
+ *  recently. Call this while not rendering frames.
+ */
+void ffx_display_updateFrameRate(FfxDisplayContext context);
+
+typedef struct FfxDisplayBeamStats {
+    // The fragments sent while racing, and those held back for the beam
+    // (and for how long in total, in us)
+    uint32_t fragments;
+    uint32_t delayed;
+    uint32_t delayTime;
+
+    // Fragments which may have torn; the beam was still on their rows
+    // after waiting, or the rows take too long to send to ever stay
+    // ahead of the beam (e.g. a slow SPI clock)
+    uint32_t lostRaces;
+
+    // The time the panel takes to scan a line (in ns; 0 if unknown)
+    uint32_t lineTime;
+} FfxDisplayBeamStats;
+
+/**
+ *  Enables beam racing, which times each fragment relative to the line
+ *  the panel is scanning out, so the rows being written are never the
+ *  rows being shown and frames do not tear, without a framebuffer.
+ *
+ *  With a %%pinTe%% (connected to the controller's TE output), the
+ *  tearing effect line is enabled and its edges give the start of each
+ *  refresh and (once two have been seen) the line time. Otherwise, pass
+ *  -1 and the %%lineTime%% (in ns; or 0 to derive it from the refresh
+ *  rate set with ffx_display_setFrameRate), and call
+ *  ffx_display_syncBeam with the start of a refresh.
+ *
+ *  Fragments wait (up to a refresh) for the beam, so use frame pacing
+ *  rather than a faster frame rate than the panel refresh rate. Returns
+ *  false if the rotation does not write rows in the order the panel
+ *  scans them (or the TE interrupt cannot be installed).
+ */
+bool ffx_display_enableBeamRace(FfxDisplayContext context, int32_t pinTe,
+  uint32_t lineTime);
+
+/**
+ *  Disables beam racing.
+ */
+void ffx_display_disableBeamRace(FfxDisplayContext context);
+
+/**
+ *  Sets the %%time%% (from esp_timer_get_time) a panel refresh started,
+ *  for beam racing without a TE pin.
+ */
+void ffx_display_syncBeam(FfxDisplayContext context, int64_t time);
+
+/**
+ *  Copies the beam racing statistics into %%stats%%, optionally
+ *  resetting them.
+ */
+void ffx_display_beamStats(FfxDisplayContext context,
+  FfxDisplayBeamStats *stats, bool reset);
+
+/**
+ *  Called at the start of each frame, before its first fragment is
+ *  rendered (and after any snapshot for the frame is taken).
+ */
+typedef void (*FfxDisplayFrameFunc)(FfxDisplayContext context, void *arg);
+
+/**
+ *  Sets the hook called at the start of each frame (or NULL), e.g. to
+ *  compute per-frame state shared by the fragments.
+ */
+void ffx_display_setFrameBegin(FfxDisplayContext context,
+  FfxDisplayFrameFunc frameFunc, void *arg);
+
+/**
+ *  Sets the hook called by ffx_display_renderFrame once a frame is on
+ *  the panel (or NULL).
+ */
+void ffx_display_setFrameEnd(FfxDisplayContext context,
+  FfxDisplayFrameFunc frameFunc, void *arg);
+
+/**
+ *  Pace frames to the panel refresh (see ffx_display_setFramePacing).
+ *
+ *  Once the refresh can be timed (with beam racing, from the TE pin or
+ *  ffx_display_syncBeam; see ffx_display_enableBeamRace), each frame is
+ *  due at the start of a refresh, so frames are locked to it. Otherwise
+ *  this only matches the refresh rate, so frames drift against it.
+ */
+#define FFX_DISPLAY_PACING_REFRESH    (0xffff)
+
+/**
+ *  Paces frames to %%fps%% (0 to render frames as fast as possible, or
+ *  FFX_DISPLAY_PACING_REFRESH to lock to the panel refresh, which
+ *  follows an adaptive refresh rate).
+ *
+ *  Each frame is started as late as possible while still completing by
+ *  its deadline, based on how long recent frames took, so the state it
+ *  shows (e.g. input) is as fresh as possible and frames are evenly
+ *  spaced. ffx_display_renderFragment sleeps before the first fragment
+ *  of a frame until then; ffx_display_submitFragment instead returns
+ *  FfxDisplayStatusWouldBlock.
+ */
+void ffx_display_setFramePacing(FfxDisplayContext context, uint16_t fps);
+
+/**
+ *  What to do when frames take longer than their budget (see
+ *  ffx_display_setOverrunPolicy).
+ */
+typedef enum FfxDisplayOverrunPolicy {
+    // Only count overruns; with frame pacing, a late frame starts at
+    // once and the pacing continues from it
+    FfxDisplayOverrunNone = 0,
+
+    // With frame pacing, frames keep to the frame times; a late frame
+    // drops the frames whose times have passed, so animations using
+    // ffx_display_frameTime stay time-correct
+    FfxDisplayOverrunDrop,
+
+    // With frame pacing, the frame rate is halved (down to 1/8) on each
+    // overrun, and doubled again once frames would fit at that rate
+    FfxDisplayOverrunHalveRate,
+
+    // While frames overrun, fragments which cost more than average to
+    // render are only updated every other frame (the rest of the screen
+    // is updated every frame)
+    FfxDisplayOverrunSkipFragments
+} FfxDisplayOverrunPolicy;
+
+typedef struct FfxDisplayOverrunStats {
+    // Frames checked against the budget, and those over it
+    uint32_t frames;
+    uint32_t overruns;
+
+    // The frame number (see FfxDisplayFrameInfo) of the last overrun
+    uint32_t lastOverrunFrame;
+
+    // Frames dropped (FfxDisplayOverrunDrop)
+    uint32_t droppedFrames;
+
+    // Fragments left as they were (FfxDisplayOverrunSkipFragments), and
+    // whether fragments are currently being skipped
+    uint32_t skippedFragments;
+    bool skipping;
+
+    // The current frame rate divisor (FfxDisplayOverrunHalveRate)
+    uint16_t rateDivisor;
+
+    // The longest frame (in us), and the first row of its most
+    // expensive fragment, to help find the offending screen
+    uint32_t worstFrameTime;
+    uint16_t worstFrameY;
+} FfxDisplayOverrunStats;
+
+/**
+ *  Sets the %%budget%% for each frame in microseconds (or 0 for the
+ *  frame pacing period, see ffx_display_setFramePacing) and the
+ *  %%policy%% applied when a frame exceeds it.
+ *
+ *  The Drop and HalveRate policies require frame pacing. Returns false
+ *  if memory for the fragment costs cannot be allocated.
+ */
+bool ffx_display_setOverrunPolicy(FfxDisplayContext context,
+  FfxDisplayOverrunPolicy policy, uint32_t budget);
+
+/**
+ *  Declares the rows from %%y0%% (%%height%% rows) as a priority region
+ *  (e.g. a cursor, progress bar or waveform), which is updated on every
+ *  frame while the rest of the screen is only updated on every n-th
+ *  frame (see ffx_display_setRefreshDivisor). On the frames between,
+ *  only the fragments which intersect a priority region are rendered
+ *  and sent.
+ *
+ *  Returns the region, to remove it later, or -1 if the rows are
+ *  outside the display or there are already 4 regions.
+ */
+int32_t ffx_display_addPriorityRegion(FfxDisplayContext context,
+  uint32_t y0, uint32_t height);
+
+/**
+ *  Removes a priority region returned by ffx_display_addPriorityRegion.
+ */
+void ffx_display_removePriorityRegion(FfxDisplayContext context,
+  int32_t region);
+
+/**
+ *  Only update the rows outside the priority regions on every
+ *  %%divisor%%-th frame (0 or 1 to update the whole screen on every
+ *  frame). Ignored while page flipping.
+ */
+void ffx_display_setRefreshDivisor(FfxDisplayContext context,
+  uint16_t divisor);
+
+/**
+ *  Copies the overrun statistics (and the policy decisions) into
+ *  %%stats%%, optionally resetting them.
+ */
+void ffx_display_overrunStats(FfxDisplayContext context,
+  FfxDisplayOverrunStats *stats, bool reset);
+
+/**
+ *  Returns the time the current frame started (in microseconds, from
+ *  esp_timer_get_time), which is the same for every fragment of a frame,
+ *  so a [[RenderFunc]] can use it to advance animations consistently.
+ */
+int64_t ffx_display_frameTime(FfxDisplayContext context);
+
+/**
+ *  Renders each fragment as two halves, split by %%split%%, with
+ *  %%renderFunc%% called concurrently for the second half on a worker
+ *  task on the other core and for the first half on the calling task;
+ *  the fragment is sent once both are done. This nearly doubles the
+ *  render throughput of a CPU-bound render function, which must be
+ *  safe to call concurrently (i.e. only write its own rectangle). Both
+ *  receive the render context from the init call.
+ *
+ *  Pass NULL to return to the [[RenderFunc]] (e.g. for simple screens).
+ *
+ *  Returns false on a single-core target, or if the worker task cannot
+ *  be created.
+ */
+bool ffx_display_setParallelRender(FfxDisplayContext context,
+  FfxRenderRectFunc renderFunc, FfxDisplaySplit split);
+
 /**
  *  Returns the current FPS statistic.
  */
 uint16_t ffx_display_fps(FfxDisplayContext context);
 
+/**
+ *  Returns the time-to-first-frame statistic, in microseconds from the
+ *  start of ffx_display_init until the last fragment of the first frame
+ *  is on the panel (0 until then), and sets %%initTime%% (if non-NULL)
+ *  to the time spent in the reset and initialization sequence.
+ */
+uint32_t ffx_display_startupTime(FfxDisplayContext context,
+  uint32_t *initTime);
+
+/**
+ *  Returns the size of the display, after rotation.
+ */
+uint16_t ffx_display_width(FfxDisplayContext context);
+uint16_t ffx_display_height(FfxDisplayContext context);
+
+/**
+ *  Returns the rows per fragment and the number of fragments per frame.
+ */
+uint16_t ffx_display_fragmentHeight(FfxDisplayContext context);
+uint16_t ffx_display_fragmentCount(FfxDisplayContext context);
+
+
+/**
+ *  Prefetch
+ *
+ *  Render callbacks that read flash-mapped or compressed assets stall
+ *  on cache misses while the SPI DMA is idle. A prefetcher moves that
+ *  work off the render path: while fragment N is on the wire, a
+ *  background task calls the %%fetchFunc%% to pull the source data for
+ *  the next fragment into an internal RAM staging buffer, so the
+ *  render callback only copies from fast RAM.
+ *
+ *  The task runs on the other core where available; on single-core
+ *  targets it runs while the render task is blocked waiting for DMA.
+ */
+
+/**
+ *  Called from the prefetch task (or the render task on a miss) to
+ *  fill %%staging%% with whatever the render callback needs for the
+ *  fragment at %%y0%%.
+ */
+typedef void (*FfxPrefetchFunc)(void *staging, uint32_t y0, void *context);
+
+/**
+ *  Prefetch Object.
+ *
+ *  This is intentionally opaque; do not inspect or rely on internals.
+ */
+typedef void* FfxPrefetch;
+
+typedef struct FfxPrefetchStats {
+    // Staging was ready when the render callback asked for it
+    uint32_t hits;
+
+    // The prefetch was in progress; the render callback waited for it
+    uint32_t waits;
+
+    // Nothing was prefetched; fetched synchronously in the render callback
+    uint32_t misses;
+} FfxPrefetchStats;
+
+/**
+ *  Creates a prefetcher with two staging buffers of %%stagingSize%%
+ *  bytes (in internal RAM) and starts its task.
+ *
+ *  Returns NULL if the memory or task cannot be allocated.
+ */
+FfxPrefetch ffx_prefetch_init(size_t stagingSize, FfxPrefetchFunc fetchFunc,
+  void *context);
+
+/**
+ *  Stops the prefetch task and releases the staging buffers. It must
+ *  be detached from any display first.
+ */
+void ffx_prefetch_free(FfxPrefetch prefetch);
+
+/**
+ *  Returns the staging buffer holding the data for the fragment at
+ *  %%y0%%, waiting for it if it is being prefetched or fetching it
+ *  immediately if not. Call this from the render callback; the buffer
+ *  is valid until the render callback returns.
+ */
+const void* ffx_prefetch_get(FfxPrefetch prefetch, uint32_t y0);
+
+/**
+ *  Copies the hit/miss counters into %%stats%%.
+ */
+void ffx_prefetch_stats(FfxPrefetch prefetch, FfxPrefetchStats *stats);
+
+/**
+ *  Attaches %%prefetch%% (or detaches with NULL) to the display, which
+ *  then requests the next fragment's data each time it renders one.
+ */
+void ffx_display_setPrefetch(FfxDisplayContext context, FfxPrefetch prefetch);
+
+
+
+/**
+ *  Snapshot
+ *
+ *  The [[RenderFunc]] is called for each fragment of a frame, and the
+ *  app state may change between them, so fragments of one frame can
+ *  show different states (a visible shear). A snapshot lets the app
+ *  publish its state as often as it likes (e.g. from another task),
+ *  while every fragment of a frame reads the same copy, which is only
+ *  replaced at the start of the next frame.
+ *
+ *  There are three copies of the state, which are exchanged atomically,
+ *  so neither publishing nor reading takes a lock or waits.
+ */
+
+/**
+ *  Snapshot Object.
+ *
+ *  This is intentionally opaque; do not inspect or rely on internals.
+ */
+typedef void* FfxSnapshot;
+
+/**
+ *  Creates a snapshot of a %%size%% byte state (initially zeroed).
+ *
+ *  Returns NULL if the memory cannot be allocated.
+ */
+FfxSnapshot ffx_snapshot_init(size_t size);
+
+/**
+ *  Releases the snapshot. It must be detached from any display first.
+ */
+void ffx_snapshot_free(FfxSnapshot snapshot);
+
+/**
+ *  Returns the state to update, which starts as a copy of the last
+ *  published state. Only one task may edit and publish.
+ */
+void* ffx_snapshot_edit(FfxSnapshot snapshot);
+
+/**
+ *  Publishes the edited state, which the next frame will show; the
+ *  pointer from ffx_snapshot_edit must not be used after this.
+ */
+void ffx_snapshot_publish(FfxSnapshot snapshot);
+
+/**
+ *  Returns the state for the current frame. Call this from the render
+ *  callback; the state does not change until the next frame.
+ */
+const void* ffx_snapshot_get(FfxSnapshot snapshot);
+
+/**
+ *  Attaches %%snapshot%% (or detaches with NULL) to the display, which
+ *  then takes the latest published state at the start of each frame.
+ */
+void ffx_display_setSnapshot(FfxDisplayContext context, FfxSnapshot snapshot);
 
 #ifdef __cplusplus
 }
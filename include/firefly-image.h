@@ -0,0 +1,123 @@
+#ifndef __FIREFLY_IMAGE_H__
+#define __FIREFLY_IMAGE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ *  Image Asset Format
+ *
+ *  An image asset is a 16 byte header followed by the image data. All
+ *  header fields are little-endian.
+ *
+ *    0   "FFXI"           - magic
+ *    4   uint8            - version (1)
+ *    5   uint8            - format (FfxImageFormat)
+ *    6   uint16           - width
+ *    8   uint16           - height
+ *    10  uint16           - palette size (palette format), otherwise 0
+ *    12  uint32           - data length (bytes following the row index)
+ *
+ *  FfxImageFormatRaw:
+ *    width * height RGB565 pixels, each stored MSB first (i.e. the
+ *    display pixel order, so rows can be copied directly).
+ *
+ *  FfxImageFormatPalette:
+ *    uint16 palette[paletteSize] - RGB565, each stored MSB first
+ *    uint8 indices[width * height]
+ *
+ *  FfxImageFormatCompressed:
+ *    uint32 rowOffsets[height] - offset of each row's first op,
+ *                                relative to the start of the data
+ *    ops...
+ *
+ *    Every row is encoded independently, so decoding can start at
+ *    any row. At the start of each row the previous pixel is 0x0000
+ *    and the 64 entry color cache is cleared. Ops (by top 2 bits):
+ *
+ *      00nnnnnn  RUN      - repeat the previous pixel n + 1 times
+ *      01nnnnnn  LITERAL  - n + 1 pixels follow (2 bytes each, MSB first)
+ *      10iiiiii  INDEX    - the pixel at cache[i]
+ *      11rrggbb  DIFF     - the previous pixel with each channel
+ *                           adjusted by (value - 2), wrapping
+ *
+ *    Each LITERAL and DIFF pixel is stored in the cache at
+ *    FFX_IMAGE_HASH(pixel), where pixel is the native RGB565 value.
+ */
+#define FFX_IMAGE_MAGIC         ("FFXI")
+#define FFX_IMAGE_VERSION       (1)
+#define FFX_IMAGE_HEADER_SIZE   (16)
+
+#define FFX_IMAGE_OP_RUN        (0x00)
+#define FFX_IMAGE_OP_LITERAL    (0x40)
+#define FFX_IMAGE_OP_INDEX      (0x80)
+#define FFX_IMAGE_OP_DIFF       (0xc0)
+#define FFX_IMAGE_OP_MASK       (0xc0)
+
+#define FFX_IMAGE_HASH(v)  ((((v) >> 11) * 3 + (((v) >> 5) & 0x3f) * 5 + ((v) & 0x1f) * 7) & 0x3f)
+
+typedef enum FfxImageFormat {
+    FfxImageFormatRaw           = 0,
+    FfxImageFormatCompressed    = 1,
+    FfxImageFormatPalette       = 2,
+} FfxImageFormat;
+
+/**
+ *  A parsed image asset. This only references the asset data, which
+ *  must remain valid (it is usually in flash) while the image is used.
+ */
+typedef struct FfxImage {
+    FfxImageFormat format;
+    uint16_t width;
+    uint16_t height;
+
+    // Compressed only; the row index (unaligned little-endian uint32)
+    const uint8_t *rowOffsets;
+
+    // Palette only; the palette entries, in display pixel order
+    const uint8_t *palette;
+    uint16_t paletteSize;
+
+    // The pixels (raw), ops (compressed) or indices (palette)
+    const uint8_t *data;
+    uint32_t length;
+} FfxImage;
+
+/**
+ *  Parses the asset %%data%% into %%image%%, returning false if the
+ *  data is not a valid (or supported) image asset.
+ */
+bool ffx_image_init(FfxImage *image, const uint8_t *data, size_t length);
+
+/**
+ *  Decodes %%rowCount%% rows, starting at image row %%y0%%, into
+ *  %%pixels%% in display pixel order. Each row writes
+ *  min(width, stride) pixels and the next row begins %%stride%% pixels
+ *  later. Rows beyond the image height are left untouched.
+ *
+ *  Returns false if the asset is corrupt (e.g. truncated ops or a
+ *  palette index beyond the palette), in which case the remaining rows
+ *  are left undecoded; no data is read outside the asset.
+ *
+ *  Only the requested rows are decoded, so a render callback can
+ *  decode exactly the rows of the current fragment:
+ *
+ *    ffx_image_decodeRows(&image, y0, FfxDisplayFragmentHeight,
+ *      pixels, FfxDisplayFragmentWidth);
+ */
+bool ffx_image_decodeRows(const FfxImage *image, uint32_t y0,
+  uint32_t rowCount, uint16_t *pixels, uint32_t stride);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __FIREFLY_IMAGE_H__ */
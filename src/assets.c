@@ -0,0 +1,223 @@
+/**
+ *  Asset bundles; see firefly-assets.h for the format.
+ *
+ *  On ESP-IDF the bundle is a data partition mapped into the address
+ *  space, so render callbacks read (or decode) pixels straight from
+ *  flash. On a host the same lookup code runs against a mapped file.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#if ESP_PLATFORM
+#include <esp_partition.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "firefly-assets.h"
+
+
+typedef struct _Assets {
+    const uint8_t *data;
+    uint32_t length;
+    uint32_t count;
+
+#if ESP_PLATFORM
+    esp_partition_mmap_handle_t handle;
+#else
+    size_t mappedLength;
+#endif
+} _Assets;
+
+static uint32_t readUint16(const uint8_t *data) {
+    return data[0] | (data[1] << 8);
+}
+
+static uint32_t readUint32(const uint8_t *data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+// Returns the bundle length from a header, or 0 if it is not a bundle
+static uint32_t checkHeader(const uint8_t *header) {
+    if (memcmp(header, FFX_ASSETS_MAGIC, 4)) { return 0; }
+    if (header[4] != FFX_ASSETS_VERSION) { return 0; }
+    return readUint32(&header[8]);
+}
+
+// Validate the directory, so lookups never read outside the mapping
+static bool checkDirectory(const _Assets *assets) {
+    const uint8_t *entries = &assets->data[FFX_ASSETS_HEADER_SIZE];
+    if (FFX_ASSETS_HEADER_SIZE + assets->count * FFX_ASSETS_ENTRY_SIZE > assets->length) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < assets->count; i++) {
+        const uint8_t *entry = &entries[i * FFX_ASSETS_ENTRY_SIZE];
+        if (entry[FFX_ASSETS_NAME_LENGTH - 1] != 0) { return false; }
+
+        uint32_t offset = readUint32(&entry[FFX_ASSETS_NAME_LENGTH]);
+        uint32_t length = readUint32(&entry[FFX_ASSETS_NAME_LENGTH + 4]);
+        if (offset > assets->length || length > assets->length - offset) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#if ESP_PLATFORM
+
+static bool mapAssets(_Assets *assets, const char *label) {
+    const esp_partition_t *partition = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (partition == NULL) { return false; }
+
+    // Map just the header first, to learn how much to map
+    const void *data = NULL;
+    esp_partition_mmap_handle_t handle;
+    esp_err_t result = esp_partition_mmap(partition, 0, FFX_ASSETS_HEADER_SIZE,
+      ESP_PARTITION_MMAP_DATA, &data, &handle);
+    if (result != ESP_OK) { return false; }
+
+    uint32_t length = checkHeader(data);
+    esp_partition_munmap(handle);
+
+    if (length < FFX_ASSETS_HEADER_SIZE || length > partition->size) {
+        return false;
+    }
+
+    result = esp_partition_mmap(partition, 0, length, ESP_PARTITION_MMAP_DATA,
+      &data, &assets->handle);
+    if (result != ESP_OK) { return false; }
+
+    assets->data = data;
+    assets->length = length;
+
+    return true;
+}
+
+static void unmapAssets(_Assets *assets) {
+    esp_partition_munmap(assets->handle);
+}
+
+#else
+
+static bool mapAssets(_Assets *assets, const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) { return false; }
+
+    struct stat info;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size >= FFX_ASSETS_HEADER_SIZE) {
+        data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (data == MAP_FAILED) { return false; }
+
+    uint32_t length = checkHeader(data);
+    if (length < FFX_ASSETS_HEADER_SIZE || length > info.st_size) {
+        munmap(data, info.st_size);
+        return false;
+    }
+
+    assets->data = data;
+    assets->length = length;
+    assets->mappedLength = info.st_size;
+
+    return true;
+}
+
+static void unmapAssets(_Assets *assets) {
+    munmap((void*)assets->data, assets->mappedLength);
+}
+
+#endif
+
+FfxAssets ffx_assets_open(const char *source) {
+    _Assets *assets = malloc(sizeof(_Assets));
+    if (assets == NULL) { return NULL; }
+    memset(assets, 0, sizeof(_Assets));
+
+    if (!mapAssets(assets, source)) {
+        free(assets);
+        return NULL;
+    }
+
+    assets->count = readUint16(&assets->data[6]);
+
+    if (!checkDirectory(assets)) {
+        unmapAssets(assets);
+        free(assets);
+        return NULL;
+    }
+
+    return assets;
+}
+
+void ffx_assets_close(FfxAssets _assets) {
+    _Assets *assets = _assets;
+    if (!assets) { return; }
+
+    unmapAssets(assets);
+    free(assets);
+}
+
+uint32_t ffx_assets_count(FfxAssets _assets) {
+    _Assets *assets = _assets;
+    if (!assets) { return 0; }
+    return assets->count;
+}
+
+static const uint8_t* getEntry(const _Assets *assets, uint32_t index) {
+    return &assets->data[FFX_ASSETS_HEADER_SIZE + index * FFX_ASSETS_ENTRY_SIZE];
+}
+
+const char* ffx_assets_name(FfxAssets _assets, uint32_t index) {
+    _Assets *assets = _assets;
+    if (!assets || index >= assets->count) { return NULL; }
+    return (const char*)getEntry(assets, index);
+}
+
+const uint8_t* ffx_assets_find(FfxAssets _assets, const char *name,
+  size_t *length) {
+
+    _Assets *assets = _assets;
+    if (!assets) { return NULL; }
+
+    // Binary search the (sorted) directory
+    uint32_t lo = 0, hi = assets->count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        const uint8_t *entry = getEntry(assets, mid);
+
+        int cmp = strncmp(name, (const char*)entry, FFX_ASSETS_NAME_LENGTH);
+        if (cmp == 0) {
+            if (length) {
+                *length = readUint32(&entry[FFX_ASSETS_NAME_LENGTH + 4]);
+            }
+            return &assets->data[readUint32(&entry[FFX_ASSETS_NAME_LENGTH])];
+        }
+
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    return NULL;
+}
+
+bool ffx_assets_findImage(FfxAssets assets, const char *name,
+  FfxImage *image) {
+
+    size_t length = 0;
+    const uint8_t *data = ffx_assets_find(assets, name, &length);
+    if (data == NULL) { return false; }
+    return ffx_image_init(image, data, length);
+}
@@ -4,6 +4,7 @@ typedef enum Command {
     CommandNOP                    = 0x00,      // No-op
     CommandSWRESET                = 0x01,      // Software Reset
     CommandSLPOUT                 = 0x11,      // Sleep Out
+    CommandPTLON                  = 0x12,      // Partial Display Mode On
     CommandNORON                  = 0x13,      // Normal Display Mode On
 
     CommandINVOFF                 = 0x20,      // Display Inversion Off
@@ -14,6 +15,14 @@ typedef enum Command {
     CommandRASET                  = 0x2b,      // Row Address Set (4 parameters)
     CommandRAMWR                  = 0x2c,      // Memory Write (N parameters)
 
+    CommandPTLAR                  = 0x30,      // Partial Area (4 parameters)
+
+    CommandVSCRDEF                = 0x33,      // Vertical Scrolling Definition (6 parameters)
+
+    CommandTEOFF                  = 0x34,      // Tearing Effect Line Off
+    CommandTEON                   = 0x35,      // Tearing Effect Line On (1 parameter)
+    CommandTEON_1_vblank          = 0x00,      // - V-Blank only (vs. V-Blank and H-Blank)
+
     CommandMADCTL                 = 0x36,      // Memory Data Access Control (1 parameter)
     CommandMADCTL_1_page          = (1 << 7),  // - Bottom to Top (vs. Top to Bottom)
     CommandMADCTL_1_column        = (1 << 6),  // - Right to Left (vs. Left to Right)
@@ -22,6 +31,8 @@ typedef enum Command {
     CommandMADCTL_1_rgb           = (1 << 3),  // - BGR (vs. RGB)
     CommandMADCTL_1_data_latch    = (1 << 2),  // - LCD Refresh Right to Left (vs. LCD Refresh Left to Right)
 
+    CommandVSCSAD                 = 0x37,      // Vertical Scroll Start Address of RAM (2 parameters)
+
     CommandCOLMOD                 = 0x3a,      // Interface Pixel Format (1 parameter)
     CommandCOLMOD_1_format_65k    = 0x50,      // 65k colors
     CommandCOLMOD_1_format_262k   = 0x30,      // 262k colors
@@ -78,6 +89,7 @@ typedef enum Command {
     CommandPVGAMCTRL              = 0xe0,      // Positive Voltage Gamma Control (14 parameters)
     CommandNVGAMCTRL              = 0xe1,      // Negative Voltage Gamma Control (14 parameters)
 
+    CommandEscape                 = 0xfc,      // Pseudo-Command; internal use only; send the next byte as a command (then the parameter count and parameters)
     CommandDone                   = 0xfd,      // Pseudo-Command; internal use only; done commands
     CommandResetPin               = 0xfe,      // Pseudo-Command; internal use only; set reset pin value (1 parameter)
     CommandWait                   = 0xff,      // Pseudo-Command; internal use only; wait Xms (1 parameter)
@@ -0,0 +1,308 @@
+/**
+ *  Display controllers (driver ICs).
+ *
+ *  Each controller provides its initialization sequence, frame memory
+ *  size and addressing; the fragment engine in display.c is shared.
+ *  The pseudo-commands (see commands.h) are the same as the public
+ *  FFX_DISPLAY_INIT_* values.
+ */
+
+#include <esp_attr.h>
+#include <driver/spi_master.h>
+
+#include "firefly-display.h"
+#include "commands.h"
+
+
+_Static_assert(FFX_DISPLAY_INIT_ESCAPE == CommandEscape, "init escape mismatch");
+_Static_assert(FFX_DISPLAY_INIT_DONE == CommandDone, "init done mismatch");
+_Static_assert(FFX_DISPLAY_INIT_RESET == CommandResetPin, "init reset mismatch");
+_Static_assert(FFX_DISPLAY_INIT_WAIT == CommandWait, "init wait mismatch");
+
+
+// The LCM Control parameter; this XORs the MADCTL MX bit, which must
+// be accounted for when computing the visible region offsets
+#define LCMCTRL_PARAM     (CommandLCMCTRL_1_XBGR | CommandLCMCTRL_1_XMX | CommandLCMCTRL_1_XMH)
+
+// ST7789 Initialization Sequence
+// Place data into DRAM. Constant data gets placed into DROM by default, which is not accessible by DMA.
+DRAM_ATTR static const uint8_t st7789_init_sequence[] = {
+    CommandResetPin,   0,
+    CommandWait,       1,
+    CommandResetPin,   1,
+    CommandWait,       6,
+    CommandMADCTL,     1,   0,
+    CommandCOLMOD,     1,
+      (CommandCOLMOD_1_format_65k | CommandCOLMOD_1_width_16bit),
+    // The ENDIAN bit only affects the parallel interfaces; over SPI each
+    // pixel is always shifted MSB first, which is the order the pixel
+    // helpers in firefly-display.h (FFX_RGB565, FFX_PIXEL) produce
+    CommandRAMCTRL,    2,
+      (CommandRAMCTRL_1),
+      (CommandRAMCTRL_2 | CommandRAMCTRL_2_endian_little | CommandRAMCTRL_2_trans_msb),
+    CommandPORCTRL,    5,   0x0c, 0x0c, 0x00, 0x33, 0x33,
+    CommandGCTRL,      1,   0x45, // @TODO: Fill in ; Vgh=13.65V, Vgl=-10.43V
+    CommandVCOMS,      1,   0x2b, // @TODO: Fill in ; VCOM=1.175V
+    CommandLCMCTRL,    1,   LCMCTRL_PARAM,
+    CommandVDVVRHEN,   2,   0x01, 0xff,
+    CommandVRHS,       1,   0x11, // @TODO: Fill in ; Vap=4.4+
+    CommandVDVS,       1,   0x20, // @TODO: Fill in ; VDV=0
+    CommandFRCTRL2,    1,   (CommandFRCTRL2_1_60hz),
+    CommandPWCTRL1,    2,
+      CommandPWCTRL1_1,
+      (CommandPWCTRL1_2_AVDD_6_8 | CommandPWCTRL1_2_AVCL_4_8 | CommandPWCTRL1_2_VDS_2_3),
+    CommandPVGAMCTRL, 14,
+      0xd0, 0x00, 0x05, 0x0e, 0x15, 0x0d, 0x37, 0x43, 0x47, 0x09,
+      0x15, 0x12, 0x16, 0x19,
+    CommandNVGAMCTRL, 14,
+      0xd0, 0x00, 0x05, 0x0d, 0x0c, 0x06, 0x2d, 0x44, 0x40, 0x0e,
+      0x1c, 0x18, 0x16, 0x19,
+    CommandSLPOUT,     0,
+    CommandWait,       6, // only need to wait for 5ms
+    CommandDISPON,     0,
+    CommandINVON,      0,
+    CommandNORON,      0,
+    CommandCASET,      4,   0, 0, 0, 0,  // Computed from the rotation offsets
+    CommandDone
+};
+
+// The ST7789 refreshes at 10MHz / ((320 + porches) * (250 + 16 * RTNA))
+// lines per second, with the 12 line porches of the PORCTRL above
+#define ST7789_FRAME_CLOCKS      (10000000 / (320 + 12 + 12))
+
+static uint16_t st7789_frameRate(uint16_t hz, uint8_t *params,
+  uint8_t *paramCount) {
+
+    // The lowest RTNA (fastest) which is at most hz
+    int32_t rtna = ((ST7789_FRAME_CLOCKS / hz) - 250 + 15) / 16;
+    if (rtna < 0) { rtna = 0; }
+    if (rtna > 31) { rtna = 31; }
+
+    params[0] = rtna;
+    *paramCount = 1;
+
+    return ST7789_FRAME_CLOCKS / (250 + 16 * rtna);
+}
+
+const FfxDisplayController FfxDisplayControllerST7789 = {
+    .gramWidth = 240,
+    .gramHeight = 320,
+    .initSequence = st7789_init_sequence,
+    .commandCASET = CommandCASET,
+    .commandRASET = CommandRASET,
+    .commandRAMWR = CommandRAMWR,
+    .commandMADCTL = CommandMADCTL,
+    .madctl = 0,
+    .madctlInverted = (LCMCTRL_PARAM & CommandLCMCTRL_1_XMX) ? CommandMADCTL_1_column: 0,
+    .commandFrameRate = CommandFRCTRL2,
+    .frameRate = st7789_frameRate,
+    .clockSpeed = SPI_MASTER_FREQ_80M
+};
+
+
+// ILI9341 Initialization Sequence (a 240x320 TN panel)
+DRAM_ATTR static const uint8_t ili9341_init_sequence[] = {
+    CommandResetPin,   0,
+    CommandWait,       1,
+    CommandResetPin,   1,
+    CommandWait,       120,
+    0xef,              3,   0x03, 0x80, 0x02,
+    0xcf,              3,   0x00, 0xc1, 0x30,         // Power control B
+    0xed,              4,   0x64, 0x03, 0x12, 0x81,   // Power on sequence control
+    0xe8,              3,   0x85, 0x00, 0x78,         // Driver timing control A
+    0xcb,              5,   0x39, 0x2c, 0x00, 0x34, 0x02, // Power control A
+    0xf7,              1,   0x20,                     // Pump ratio control
+    0xea,              2,   0x00, 0x00,               // Driver timing control B
+    0xc0,              1,   0x23,                     // Power control 1
+    0xc1,              1,   0x10,                     // Power control 2
+    0xc5,              2,   0x3e, 0x28,               // VCOM control 1
+    0xc7,              1,   0x86,                     // VCOM control 2
+    CommandMADCTL,     1,   0,
+    CommandCOLMOD,     1,
+      (CommandCOLMOD_1_format_65k | CommandCOLMOD_1_width_16bit),
+    0xb1,              2,   0x00, 0x18,               // Frame rate control; 79Hz
+    0xb6,              3,   0x08, 0x82, 0x27,         // Display function control
+    0xf2,              1,   0x00,                     // 3-gamma function disable
+    0x26,              1,   0x01,                     // Gamma curve 1
+    CommandPVGAMCTRL, 15,
+      0x0f, 0x31, 0x2b, 0x0c, 0x0e, 0x08, 0x4e, 0xf1, 0x37, 0x07,
+      0x10, 0x03, 0x0e, 0x09, 0x00,
+    CommandNVGAMCTRL, 15,
+      0x00, 0x0e, 0x14, 0x03, 0x11, 0x07, 0x31, 0xc1, 0x48, 0x08,
+      0x0f, 0x0c, 0x31, 0x36, 0x0f,
+    CommandSLPOUT,     0,
+    CommandWait,       120,
+    CommandDISPON,     0,
+    CommandNORON,      0,
+    CommandCASET,      4,   0, 0, 0, 0,  // Computed from the rotation offsets
+    CommandDone
+};
+
+// The ILI9341 refreshes at 615kHz / (DIVA * RTNA * (320 + porches)),
+// with RTNA from 16 to 31 clocks per line and the default 2 line porches
+#define ILI9341_FRAME_CLOCKS     (615000 / (320 + 2 + 2))
+
+static uint16_t ili9341_frameRate(uint16_t hz, uint8_t *params,
+  uint8_t *paramCount) {
+
+    // The smallest division ratio (of 1, 2, 4 or 8) which can reach hz,
+    // and the fewest clocks per line which are at most hz
+    uint32_t diva = 0, rtna = 31;
+    for (; diva < 4; diva++) {
+        rtna = ((ILI9341_FRAME_CLOCKS >> diva) + hz - 1) / hz;
+        if (rtna <= 31) { break; }
+    }
+    if (diva > 3) { diva = 3; rtna = 31; }
+    if (rtna < 16) { rtna = 16; }
+
+    params[0] = diva;
+    params[1] = rtna;
+    *paramCount = 2;
+
+    return (ILI9341_FRAME_CLOCKS >> diva) / rtna;
+}
+
+const FfxDisplayController FfxDisplayControllerILI9341 = {
+    .gramWidth = 240,
+    .gramHeight = 320,
+    .initSequence = ili9341_init_sequence,
+    .commandCASET = CommandCASET,
+    .commandRASET = CommandRASET,
+    .commandRAMWR = CommandRAMWR,
+    .commandMADCTL = CommandMADCTL,
+    .madctl = (CommandMADCTL_1_column | CommandMADCTL_1_rgb),
+    .madctlInverted = 0,
+    .commandFrameRate = 0xb1,
+    .frameRate = ili9341_frameRate,
+    .clockSpeed = SPI_MASTER_FREQ_40M
+};
+
+
+// GC9A01 Initialization Sequence (a 240x240 round IPS panel); from the
+// vendor sequence. Several of its commands collide with the
+// pseudo-commands, so are escaped.
+DRAM_ATTR static const uint8_t gc9a01_init_sequence[] = {
+    CommandResetPin,   0,
+    CommandWait,       10,
+    CommandResetPin,   1,
+    CommandWait,       120,
+    0xef,              0,                             // Inter register enable 2
+    0xeb,              1,   0x14,
+    CommandEscape,  0xfe, 0,                          // Inter register enable 1
+    0xef,              0,
+    0xeb,              1,   0x14,
+    0x84,              1,   0x40,
+    0x85,              1,   0xff,
+    0x86,              1,   0xff,
+    0x87,              1,   0xff,
+    0x88,              1,   0x0a,
+    0x89,              1,   0x21,
+    0x8a,              1,   0x00,
+    0x8b,              1,   0x80,
+    0x8c,              1,   0x01,
+    0x8d,              1,   0x01,
+    0x8e,              1,   0xff,
+    0x8f,              1,   0xff,
+    0xb6,              2,   0x00, 0x20,               // Display function control
+    CommandMADCTL,     1,   0,
+    CommandCOLMOD,     1,   CommandCOLMOD_1_width_16bit,
+    0x90,              4,   0x08, 0x08, 0x08, 0x08,
+    0xbd,              1,   0x06,
+    0xbc,              1,   0x00,
+    CommandEscape,  0xff, 3,   0x60, 0x01, 0x04,
+    0xc3,              1,   0x13,                     // Voltage regulator 1a
+    0xc4,              1,   0x13,                     // Voltage regulator 1b
+    0xc9,              1,   0x22,                     // Voltage regulator 2a
+    0xbe,              1,   0x11,
+    0xe1,              2,   0x10, 0x0e,
+    0xdf,              3,   0x21, 0x0c, 0x02,
+    0xf0,              6,   0x45, 0x09, 0x08, 0x08, 0x26, 0x2a, // Gamma
+    0xf1,              6,   0x43, 0x70, 0x72, 0x36, 0x37, 0x6f,
+    0xf2,              6,   0x45, 0x09, 0x08, 0x08, 0x26, 0x2a,
+    0xf3,              6,   0x43, 0x70, 0x72, 0x36, 0x37, 0x6f,
+    0xed,              2,   0x1b, 0x0b,
+    0xae,              1,   0x77,
+    0xcd,              1,   0x63,
+    0x70,              9,   0x07, 0x07, 0x04, 0x0e, 0x0f, 0x09, 0x07, 0x08, 0x03,
+    0xe8,              1,   0x34,                     // Frame rate
+    0x62,             12,   0x18, 0x0d, 0x71, 0xed, 0x70, 0x70,
+                            0x18, 0x0f, 0x71, 0xef, 0x70, 0x70,
+    0x63,             12,   0x18, 0x11, 0x71, 0xf1, 0x70, 0x70,
+                            0x18, 0x13, 0x71, 0xf3, 0x70, 0x70,
+    0x64,              7,   0x28, 0x29, 0xf1, 0x01, 0xf1, 0x00, 0x07,
+    0x66,             10,   0x3c, 0x00, 0xcd, 0x67, 0x45, 0x45, 0x10, 0x00, 0x00, 0x00,
+    0x67,             10,   0x00, 0x3c, 0x00, 0x00, 0x00, 0x01, 0x54, 0x10, 0x32, 0x98,
+    0x74,              7,   0x10, 0x85, 0x80, 0x00, 0x00, 0x4e, 0x00,
+    0x98,              2,   0x3e, 0x07,
+    CommandINVON,      0,
+    CommandSLPOUT,     0,
+    CommandWait,       120,
+    CommandDISPON,     0,
+    CommandWait,       20,
+    CommandCASET,      4,   0, 0, 0, 0,  // Computed from the rotation offsets
+    CommandDone
+};
+
+const FfxDisplayController FfxDisplayControllerGC9A01 = {
+    .gramWidth = 240,
+    .gramHeight = 240,
+    .initSequence = gc9a01_init_sequence,
+    .commandCASET = CommandCASET,
+    .commandRASET = CommandRASET,
+    .commandRAMWR = CommandRAMWR,
+    .commandMADCTL = CommandMADCTL,
+    .madctl = CommandMADCTL_1_rgb,
+    .madctlInverted = 0,
+    .clockSpeed = SPI_MASTER_FREQ_80M
+};
+
+
+// ST7735R Initialization Sequence (up to a 132x162 TN panel)
+DRAM_ATTR static const uint8_t st7735_init_sequence[] = {
+    CommandResetPin,   0,
+    CommandWait,       1,
+    CommandResetPin,   1,
+    CommandWait,       120,
+    CommandSWRESET,    0,
+    CommandWait,       150,
+    CommandSLPOUT,     0,
+    CommandWait,       255,
+    0xb1,              3,   0x01, 0x2c, 0x2d,         // Frame rate control (normal)
+    0xb2,              3,   0x01, 0x2c, 0x2d,         // Frame rate control (idle)
+    0xb3,              6,   0x01, 0x2c, 0x2d, 0x01, 0x2c, 0x2d, // (partial)
+    0xb4,              1,   0x07,                     // Column inversion off
+    0xc0,              3,   0xa2, 0x02, 0x84,         // Power control 1
+    0xc1,              1,   0xc5,                     // Power control 2
+    0xc2,              2,   0x0a, 0x00,               // Power control 3
+    0xc3,              2,   0x8a, 0x2a,               // Power control 4
+    0xc4,              2,   0x8a, 0xee,               // Power control 5
+    0xc5,              1,   0x0e,                     // VCOM control 1
+    CommandINVOFF,     0,
+    CommandMADCTL,     1,   0,
+    CommandCOLMOD,     1,   CommandCOLMOD_1_width_16bit,
+    CommandPVGAMCTRL, 16,
+      0x02, 0x1c, 0x07, 0x12, 0x37, 0x32, 0x29, 0x2d, 0x29, 0x25,
+      0x2b, 0x39, 0x00, 0x01, 0x03, 0x10,
+    CommandNVGAMCTRL, 16,
+      0x03, 0x1d, 0x07, 0x06, 0x2e, 0x2c, 0x29, 0x2d, 0x2e, 0x2e,
+      0x37, 0x3f, 0x00, 0x00, 0x02, 0x10,
+    CommandNORON,      0,
+    CommandWait,       10,
+    CommandDISPON,     0,
+    CommandWait,       100,
+    CommandCASET,      4,   0, 0, 0, 0,  // Computed from the rotation offsets
+    CommandDone
+};
+
+const FfxDisplayController FfxDisplayControllerST7735 = {
+    .gramWidth = 132,
+    .gramHeight = 162,
+    .initSequence = st7735_init_sequence,
+    .commandCASET = CommandCASET,
+    .commandRASET = CommandRASET,
+    .commandRAMWR = CommandRAMWR,
+    .commandMADCTL = CommandMADCTL,
+    .madctl = (CommandMADCTL_1_page | CommandMADCTL_1_column | CommandMADCTL_1_rgb),
+    .madctlInverted = 0,
+    .clockSpeed = SPI_MASTER_FREQ_26M
+};
@@ -1,4 +1,6 @@
 /**
+ * The fragment engine, which is shared by all controllers (see
+ * controllers.c); the st7789_ functions predate the other controllers.
  *
  * Resources:
  * - https://github.com/espressif/esp-idf/blob/master/examples/peripherals/spi_master/main/spi_master_example_main.c
@@ -6,13 +8,18 @@
 
 
 
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
 #include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/semphr.h>
 #include <freertos/task.h>
 #include <driver/spi_master.h>
 #include <driver/gpio.h>
+#include <esp_rom_sys.h>
+#include <esp_timer.h>
 #include <hal/gpio_ll.h>
 #include "soc/gpio_reg.h"
 #include "soc/gpio_struct.h"
@@ -20,122 +27,440 @@
 
 #include "firefly-display.h"
 #include "commands.h"
+#include "prefetch.h"
+#include "snapshot.h"
 
 // If using a display with the CS pin pulled low;
 // this is now managed by the bus encoding
 //#define NO_CS_PIN  (1)
 
-#define DISPLAY_HEIGHT    240
-#define DISPLAY_WIDTH     240
-
+// The default fragment height, if a panel does not specify one
 #define FRAGMENT_HEIGHT   24
 
-// This is a HARD requirement; otherwise expect infinite loops and nothing to work
-#if (240 % FRAGMENT_HEIGHT) != 0
-#error "Fragment Height is not a factor of 240"
-#endif
+// A fragment is sent as up to this many windows (e.g. when it wraps
+// around the scroll area), each a RASET and a RAMWR command and data
+#define MAX_WINDOWS       2
+#define TRANSACTION_COUNT (4 * MAX_WINDOWS)
 
-// The height of each fragment; this **MUST** be a factor of 240 (or there will be infinite loops)
-const uint8_t FfxDisplayFragmentHeight = FRAGMENT_HEIGHT;
-const uint8_t FfxDisplayFragmentWidth = DISPLAY_WIDTH;
-
-const uint8_t FfxDisplayFragmentCount = DISPLAY_HEIGHT / FRAGMENT_HEIGHT;
-
-
-// ST7789 Initialization Sequence
-// Place data into DRAM. Constant data gets placed into DROM by default, which is not accessible by DMA.
-DRAM_ATTR static const uint8_t st7789_init_sequence[] = {
-    CommandResetPin,   0,
-    CommandWait,       1,
-    CommandResetPin,   1,
-    CommandWait,       6,
-    CommandMADCTL,     1,   0,
-    CommandCOLMOD,     1,
-      (CommandCOLMOD_1_format_65k | CommandCOLMOD_1_width_16bit),
-    CommandRAMCTRL,    2,
-      (CommandRAMCTRL_1),
-      (CommandRAMCTRL_2 | CommandRAMCTRL_2_endian_little | CommandRAMCTRL_2_trans_msb),
-    CommandPORCTRL,    5,   0x0c, 0x0c, 0x00, 0x33, 0x33,
-    CommandGCTRL,      1,   0x45, // @TODO: Fill in ; Vgh=13.65V, Vgl=-10.43V
-    CommandVCOMS,      1,   0x2b, // @TODO: Fill in ; VCOM=1.175V
-    CommandLCMCTRL,    1,
-      (CommandLCMCTRL_1_XBGR | CommandLCMCTRL_1_XMX | CommandLCMCTRL_1_XMH),
-    CommandVDVVRHEN,   2,   0x01, 0xff,
-    CommandVRHS,       1,   0x11, // @TODO: Fill in ; Vap=4.4+
-    CommandVDVS,       1,   0x20, // @TODO: Fill in ; VDV=0
-    CommandFRCTRL2,    1,   (CommandFRCTRL2_1_60hz),
-    CommandPWCTRL1,    2,
-      CommandPWCTRL1_1,
-      (CommandPWCTRL1_2_AVDD_6_8 | CommandPWCTRL1_2_AVCL_4_8 | CommandPWCTRL1_2_VDS_2_3),
-    CommandPVGAMCTRL, 14,
-      0xd0, 0x00, 0x05, 0x0e, 0x15, 0x0d, 0x37, 0x43, 0x47, 0x09,
-      0x15, 0x12, 0x16, 0x19,
-    CommandNVGAMCTRL, 14,
-      0xd0, 0x00, 0x05, 0x0d, 0x0c, 0x06, 0x2d, 0x44, 0x40, 0x0e,
-      0x1c, 0x18, 0x16, 0x19,
-    CommandSLPOUT,     0,
-    CommandWait,       6, // only need to wait for 5ms
-    CommandDISPON,     0,
-    CommandINVON,      0,
-    CommandNORON,      0,
-    CommandCASET,      4,
-      (0 >> 8),
-      (0 & 0xff),
-      ((DISPLAY_WIDTH - 1) >> 8),
-      ((DISPLAY_WIDTH - 1) & 0xff),
-    CommandDone
+// The transaction user data (see st7789_wrapTransaction) is the D/C pin
+// and its level; the last transaction of a fragment is also marked, with
+// its window (so the post-transfer callback can find its display)
+#define USER_LAST         (1 << 8)
+#define USER_WINDOW_SHIFT (9)
+
+#define USER_WINDOW_MASK  (0x3f)
+
+// Marks the last data transaction of the last rows of a frame
+#define USER_FRAME_END    (1 << 15)
+
+// The transfer limit ESP-IDF uses for a DMA bus initialized without a
+// max_transfer_sz, assumed for a bus initialized by another component
+#define SPI_DEFAULT_MAX_TRANSFER  (4092)
+
+// No fragment of the frame has been sent
+#define NO_FRAGMENT       (0xffff)
+
+// With an adaptive frame rate, frames closer together than this (in ms)
+// are an animation and raise the refresh rate; a longer pause lowers it
+#define FRAME_RATE_HOLD   (500)
+
+// With frame pacing, frames are started this long (in us) before they
+// are expected to be needed, to absorb jitter in the render time
+#define PACING_MARGIN     (1000)
+
+// Waits within a tick are blocked on a timer until this long (in us)
+// before the deadline, which covers its dispatch latency, then spun
+#define SLEEP_SPIN        (200)
+
+// With FfxDisplayOverrunHalveRate, the frame rate is doubled again after
+// this many frames in a row would have fit in the budget at that rate
+#define OVERRUN_RECOVERY  (30)
+#define MAX_RATE_DIVISOR  (8)
+
+// The rows updated on every frame (see ffx_display_addPriorityRegion)
+#define MAX_PRIORITY_REGIONS  (4)
+
+// The lines of the vertical blanking period (the porches), which the
+// panel scans after the TE edge and before the first frame memory line
+#define BEAM_BLANK_LINES  (24)
+
+// Set once an asynchronous initialization is complete
+#define READY_BIT         (1 << 0)
+
+// The Firefly panel; the 240x240 region at the top of the frame memory
+const FfxDisplayPanel FfxDisplayPanel240x240 = {
+    .controller = &FfxDisplayControllerST7789,
+    .width = 240, .height = 240
+};
+
+const FfxDisplayPanel FfxDisplayPanel240x320 = {
+    .controller = &FfxDisplayControllerST7789,
+    .width = 240, .height = 320, .fragmentHeight = 20
+};
+
+// Vendor code uses column 52 with MADCTL 0 and 53 with MX, with the same
+// LCMCTRL, whose XMX inverts MX; so unmirrored, the region is at 53
+const FfxDisplayPanel FfxDisplayPanel135x240 = {
+    .controller = &FfxDisplayControllerST7789,
+    .width = 135, .height = 240, .columnOffset = 53, .rowOffset = 40
+};
+
+const FfxDisplayPanel FfxDisplayPanel172x320 = {
+    .controller = &FfxDisplayControllerST7789,
+    .width = 172, .height = 320, .columnOffset = 34, .fragmentHeight = 20
+};
+
+const FfxDisplayPanel FfxDisplayPanelILI9341_240x320 = {
+    .controller = &FfxDisplayControllerILI9341,
+    .width = 240, .height = 320, .fragmentHeight = 20
+};
+
+// Round; the corners are not visible
+const FfxDisplayPanel FfxDisplayPanelGC9A01_240x240 = {
+    .controller = &FfxDisplayControllerGC9A01,
+    .width = 240, .height = 240
+};
+
+// The common "green tab" modules
+const FfxDisplayPanel FfxDisplayPanelST7735_128x160 = {
+    .controller = &FfxDisplayControllerST7735,
+    .width = 128, .height = 160, .columnOffset = 2, .rowOffset = 1,
+    .fragmentHeight = 20
 };
 
+// The fragment geometry of the default (240x240) panel
+const uint8_t FfxDisplayFragmentHeight = FRAGMENT_HEIGHT;
+const uint8_t FfxDisplayFragmentWidth = 240;
+
+const uint8_t FfxDisplayFragmentCount = 240 / FRAGMENT_HEIGHT;
+
+
 typedef enum MessageType {
     MessageTypeCommand      = 0,
     MessageTypeData         = 1
 } MessageType;
 
 
+// The displays on a SPI host share a pair of fragment buffers, since
+// only one fragment can be on the wire at a time anyway
+typedef struct _Bus {
+    spi_host_device_t host;
+
+    // The number of displays attached
+    uint32_t refCount;
+
+    // The bus was initialized by another component, so is not freed
+    bool external;
+
+    // A display without a CS pin is attached, so it cannot be shared
+    bool nocs;
+
+    // The largest transaction the bus was initialized for
+    size_t maxTransfer;
+
+    // Two fragments, one for inflight data to the SPI hardware and one
+    // for a backbuffer, sized for the largest display
+    uint16_t *fragments[2];
+    size_t fragmentSize;
+
+    // The currently inflight fragment (-1 for none) and its display
+    int8_t inflightFragment;
+    struct _Context *inflight;
+
+    // A fragment rendered by ffx_display_submitFragment, waiting for the
+    // inflight fragment to complete before it is sent (NULL for none)
+    struct _Context *staged;
+    int8_t stagedFragment;
+    uint16_t stagedY;
+    uint16_t stagedRows;
+
+    // A display whose init task is using the bus (see
+    // ffx_display_initAsync); NULL for none
+    struct _Context *volatile initializing;
+} _Bus;
+
+// A sub-rectangle of a fragment, rendered by the worker on the other
+// core (see ffx_display_setParallelRender)
+typedef struct _Worker {
+    TaskHandle_t task;
+    SemaphoreHandle_t done;
+    volatile bool stop;
+
+    FfxRenderRectFunc renderFunc;
+    void *context;
+
+    uint16_t *pixels;
+    uint32_t stride;
+    uint32_t x0, y0;
+    uint32_t width, height;
+} _Worker;
+
+typedef struct _Region {
+    bool used;
+    uint16_t y0;
+    uint16_t height;
+} _Region;
+
 typedef struct _Context {
     // The render function to use when rendering a fragment to the buffer
     FfxRenderFunc renderFunc;
     void *context;
 
-    // The SPI device (low-speed during initialization, then upgraded to high-speed)
+    // Optional; renders each fragment as two halves, one on each core
+    _Worker *worker;
+    FfxRenderRectFunc rectFunc;
+    FfxDisplaySplit split;
+
+    // Optional; pulls in the source data for the next fragment
+    FfxPrefetch prefetch;
+
+    // Optional; the state snapshot taken at the start of each frame, and
+    // a hook called then (see ffx_display_setFrameBegin)
+    FfxSnapshot snapshot;
+    FfxDisplayFrameFunc frameBeginFunc;
+    void *frameBeginArg;
+    FfxDisplayFrameFunc frameEndFunc;
+    void *frameEndArg;
+
+    // The frames completed, and for the current frame, the fragments
+    // and the time spent in the render function (in us)
+    uint32_t frameNumber;
+    uint16_t frameFragments;
+    uint32_t frameRenderTime;
+
+    // The most expensive fragment of the current frame
+    uint32_t frameWorstCost;
+    uint16_t frameWorstY;
+
+    // Overrun handling (see ffx_display_setOverrunPolicy); the render
+    // time of each fragment of the last frame (in us) and the cost over
+    // which fragments are only updated every other frame (0 for none)
+    FfxDisplayOverrunPolicy overrunPolicy;
+    uint32_t frameBudget;
+    uint16_t rateDivisor;
+    uint16_t fitFrames;
+    uint32_t *fragmentCosts;
+    uint32_t skipCost;
+    FfxDisplayOverrunStats overrunStats;
+
+    // Priority regions (see ffx_display_addPriorityRegion); only every
+    // refreshDivisor-th frame updates the rest of the screen
+    _Region regions[MAX_PRIORITY_REGIONS];
+    uint16_t refreshDivisor;
+
+    // The SPI device
     spi_device_handle_t spi;
 
-    // The prepared SPI transactions for sending fragments
-    spi_transaction_t transactions[4];
-
-    // Two fragments, one for inflight data to the SPI hardware and one for a backbuffer
-    uint8_t *fragments[2];
-
-    // The currently inflight fragment (-1 for none; first round)
-    int8_t inflightFragment;
+    // The prepared SPI transactions for sending fragments, and the
+    // number queued for the in-flight fragment
+    spi_transaction_t transactions[TRANSACTION_COUNT];
+    uint8_t pendingTransactions;
+
+    // Optional; called from the SPI interrupt as each fragment completes
+    // (see ffx_display_setFragmentCallback), with the fragment's row
+    FfxDisplayFragmentFunc fragmentFunc;
+    void *fragmentArg;
+    volatile uint16_t inflightY;
+
+    // When the data of each fragment (by y0 / fragmentHeight) last
+    // completed, captured in the SPI interrupt (in us)
+    volatile int64_t *fragmentTimes;
+
+    // The last fragment sent in the current frame, and for the last
+    // completed frame (see ffx_display_presentTime), the last fragment
+    // sent, the frame number and when it started
+    uint16_t frameLastY;
+    uint16_t presentY;
+    uint32_t presentFrame;
+    int64_t presentStart;
+
+    // The bus, which owns the fragment buffers
+    _Bus *bus;
+
+    // Displays sent the same fragments as this one (linked through
+    // their mirror field), and the display this mirrors (if any)
+    struct _Context *mirror;
+    struct _Context *primary;
 
     // The pins for D/C (Data/Contral) and Reset
     uint8_t pinDC;
     uint8_t pinReset;
 
+    // The panel geometry and its controller
+    FfxDisplayPanel panel;
+    const FfxDisplayController *controller;
+
+    // The size after rotation, and the fragment geometry
+    uint16_t width;
+    uint16_t height;
+    uint16_t fragmentHeight;
+    uint16_t fragmentCount;
+
+    // The MADCTL for the rotation and the offsets of the visible region
+    // within the frame memory for column and row addresses
+    uint8_t madctl;
+    uint16_t columnOffset;
+    uint16_t rowOffset;
+
+    // Whether the rotation exchanges rows and columns, and (if not)
+    // whether row addresses run bottom to top in the frame memory
+    bool exchange;
+    bool mirrorRows;
+
+    // Hardware vertical scrolling (see ffx_display_scroll); the row y
+    // is stored at row (y + scroll) % height of the visible region
+    bool scrolling;
+    uint16_t scroll;
+
+    // Page flipping (see ffx_display_enablePageFlip); the rows of the
+    // band are written to the hidden page, which is revealed by moving
+    // the start of a scroll area spanning both pages
+    bool flipping;
+    uint16_t bandY;
+    uint16_t bandHeight;
+    uint16_t flipTop;
+    uint16_t pageAddresses[2];
+    uint8_t page;
+
+    // Partial mode (see ffx_display_enablePartial); only the rows of the
+    // span are displayed, so frames only render and send those rows
+    bool partial;
+    uint16_t spanY;
+    uint16_t spanHeight;
+
+    // The panel refresh rate (0 if never set) and the rate requested
+    // (which the controller rounds), and the range for an adaptive
+    // refresh rate (see ffx_display_setAdaptiveFrameRate)
+    uint16_t frameRate;
+    uint16_t requestedFrameRate;
+    uint16_t minFrameRate;
+    uint16_t maxFrameRate;
+    uint32_t lastFrameTime;
+
     // The co-routine state
-    uint8_t currentY;
+    uint16_t currentY;
     uint32_t frame;  // @todo: unused?
     uint16_t fps;
 
     // Gather statistics on frame rate
     uint16_t frameCount;
     uint32_t t0;
+
+    // Frame pacing (see ffx_display_setFramePacing); the start of the
+    // current frame, when it should be complete, and an estimate of the
+    // time to render and send a frame (in us)
+    uint16_t pacingFps;
+    int64_t frameTime;
+    int64_t frameDeadline;
+    uint32_t frameDuration;
+
+    // Startup statistics (in us); see ffx_display_startupTime
+    int64_t initStart;
+    uint32_t initTime;
+    uint32_t firstFrameTime;
+
+    // When the last rows of the first frame (once ready, so not the
+    // splash) were in the frame memory, captured in the SPI interrupt
+    volatile int64_t firstFrameDone;
+
+    // Beam racing (see ffx_display_enableBeamRace); the TE pin (-1 for
+    // none), the time of the last TE edge (or ffx_display_syncBeam), and
+    // the time to scan a line given and measured from the TE edges (ns)
+    bool racing;
+    int8_t pinTe;
+    volatile int64_t vsyncTime;
+    uint32_t lineTime;
+    volatile uint32_t measuredLineTime;
+
+    // The lines of a panel refresh, including the blanking period
+    uint32_t scanLines;
+    FfxDisplayBeamStats beamStats;
+
+    // Asynchronous initialization (see ffx_display_initAsync); until
+    // ready, the init task owns the display
+    volatile bool ready;
+    EventGroupHandle_t readyEvents;
+    FfxImage splash;
+    FfxDisplayReadyFunc readyFunc;
+    void *readyArg;
+
+    // Wakes the render task within a tick (see sleepUntil); created on
+    // first use
+    esp_timer_handle_t sleepTimer;
+    SemaphoreHandle_t sleepDone;
 } _Context;
 
+static void st7789_wake(void *arg) {
+    xSemaphoreGive((SemaphoreHandle_t)arg);
+}
+
+// Wait until the time deadline (in us), for pacing and beam racing.
+// Whole ticks are slept and the rest of the last tick is blocked on a
+// timer, so short waits are not rounded up to a tick (e.g. 10ms at
+// 100Hz); only the timer latency (under SLEEP_SPIN) is spun
+static void sleepUntil(_Context *context, int64_t deadline) {
+    const int64_t tick = 1000 * portTICK_PERIOD_MS;
+
+    // A delay of n ticks ends at the n-th tick, so is at most n ticks
+    int64_t remaining = deadline - esp_timer_get_time();
+    while (remaining > tick) {
+        vTaskDelay(remaining / tick);
+        remaining = deadline - esp_timer_get_time();
+    }
+
+    if (remaining > SLEEP_SPIN && context->sleepTimer == NULL) {
+        context->sleepDone = xSemaphoreCreateBinary();
+        if (context->sleepDone) {
+            esp_timer_create_args_t args = {
+                .callback = st7789_wake,
+                .arg = context->sleepDone,
+                .name = "ffx-display"
+            };
+            if (esp_timer_create(&args, &context->sleepTimer) != ESP_OK) {
+                vSemaphoreDelete(context->sleepDone);
+                context->sleepDone = NULL;
+                context->sleepTimer = NULL;
+            }
+        }
+    }
+
+    if (remaining > SLEEP_SPIN) {
+        if (context->sleepTimer) {
+            esp_timer_start_once(context->sleepTimer, remaining - SLEEP_SPIN);
+            xSemaphoreTake(context->sleepDone, portMAX_DELAY);
+        } else {
+            // No timer; wake up to a tick late rather than spin
+            vTaskDelay(1);
+        }
+        remaining = deadline - esp_timer_get_time();
+    }
+
+    if (remaining > 0) { esp_rom_delay_us(remaining); }
+}
+
+// Wait at least duration ms; the controller waits are minimums, so this
+// may run up to a tick over rather than spin
 static void delay(uint32_t duration) {
-    vTaskDelay((duration + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS);
+    vTaskDelay(duration / portTICK_PERIOD_MS + 1);
 }
 
+// The time in ms
 static uint32_t ticks() {
-    return xTaskGetTickCount();
+    return esp_timer_get_time() / 1000;
+}
+
+// Read a time written by the SPI interrupt, which is not atomic
+static int64_t st7789_readTime(volatile int64_t *time) {
+    int64_t value;
+    do { value = *time; } while (value != *time);
+    return value;
 }
 
 static void* st7789_wrapTransaction(_Context *context, MessageType dc) {
     return (void*)((dc << 7) | context->pinDC);
 }
 
-// This is only used during initialization
+// Used for commands outside of initialization sequences
 static void st7789_send(_Context *context, MessageType dc, const uint8_t *data, int length) {
     if (length == 0) { return; }
 
@@ -151,7 +476,7 @@ static void st7789_send(_Context *context, MessageType dc, const uint8_t *data,
     assert(result == ESP_OK);
 }
 
-// The ST7789 requires a GPIO pin to be set high for data and low
+// The controller requires a GPIO pin to be set high for data and low
 // for commands. Before each transaction this is called, which
 // determines the transaxction type from the user data, which is
 // set using the st7789_wrapTransaction function.
@@ -159,7 +484,7 @@ static void IRAM_ATTR st7789_spi_pre_transfer_callback(spi_transaction_t *txn) {
     int user = (int)(txn->user);
 
     // We manage GPIO directly to keep it in IRAM, so we can call it from an ISR
-    uint32_t level = (user >> 7);
+    uint32_t level = (user >> 7) & 1;
     gpio_num_t gpio_num = (user & 0x7f);
 
     if (level) {
@@ -169,95 +494,309 @@ static void IRAM_ATTR st7789_spi_pre_transfer_callback(spi_transaction_t *txn) {
     }
 }
 
-// Initialize all pins and send the initialization sequence to the display
-static void st7789_init(_Context *context, FfxDisplayRotation rotation) {
-    // Initialize non-SPI GPIOs (this is critical, especially if one of these pins is
-    // part of the native SPI pins, even if the signal is set to -1)
-    gpio_reset_pin(context->pinDC);
-    gpio_reset_pin(context->pinReset);
+// After the last transaction of a fragment, timestamp it and notify its
+// display; the transaction is within the display's transactions, at its
+// window
+static void IRAM_ATTR st7789_spi_post_transfer_callback(spi_transaction_t *txn) {
+    int user = (int)(txn->user);
+    if (!(user & USER_LAST)) { return; }
 
-    gpio_set_direction(context->pinDC, GPIO_MODE_OUTPUT);
-    gpio_set_direction(context->pinReset, GPIO_MODE_OUTPUT);
+    uint32_t index = 4 * ((user >> USER_WINDOW_SHIFT) & USER_WINDOW_MASK) + 3;
+    _Context *context = (_Context*)((uint8_t*)(txn - index) -
+      offsetof(_Context, transactions));
 
-    // if (NO_CS_PIN) {
-    //     gpio_set_direction(10, GPIO_MODE_OUTPUT);
-    //     gpio_set_level(10, 0);
-    // }
+    // The pixels are in the frame memory
+    int64_t now = esp_timer_get_time();
+    context->fragmentTimes[context->inflightY / context->fragmentHeight] = now;
+
+    if ((user & USER_FRAME_END) && context->ready && context->firstFrameDone == 0) {
+        context->firstFrameDone = now;
+    }
+
+    if (context->fragmentFunc) {
+        context->fragmentFunc(context, context->inflightY, context->fragmentArg);
+    }
+}
+
+// The panel is starting a refresh; the TE line rises at the start of the
+// vertical blanking period. This runs with the flash cache disabled too,
+// so only reads the context (not the controller, which is in flash).
+static void IRAM_ATTR st7789_te_isr(void *arg) {
+    _Context *context = arg;
+    int64_t now = esp_timer_get_time();
+
+    // Ignore a period spanning a missed edge
+    uint32_t period = now - context->vsyncTime;
+    uint32_t lineTime = 1000 * period / context->scanLines;
+    uint32_t measured = context->measuredLineTime;
+    if (context->vsyncTime && (measured == 0 || lineTime < 2 * measured)) {
+        context->measuredLineTime = measured ? (7 * measured + lineTime) / 8: lineTime;
+    }
+
+    context->vsyncTime = now;
+}
+
+// Compute the MADCTL for a rotation, the rotated size and the offsets
+// of the visible region within the frame memory.
+//
+// The frame memory is larger than the panel, so the addresses of the
+// visible region depend on the orientation; when the rows are mirrored
+// (MY) the offset is from the end of the frame memory rather than the
+// start. When the rows and columns are exchanged (MV), the column
+// addresses (CASET) select frame memory rows, and vice versa.
+static void st7789_setRotation(_Context *context, FfxDisplayRotation rotation) {
+    uint8_t madctl = 0;
+    switch (rotation & ~FfxDisplayRotationMirror) {
+        case FfxDisplayRotationRibbonBottom:
+            madctl = 0;
+            break;
+        case FfxDisplayRotationRibbonRight:
+            madctl = (CommandMADCTL_1_page_column | CommandMADCTL_1_column);
+            break;
+        case FfxDisplayRotationRibbonTop:
+            madctl = (CommandMADCTL_1_page | CommandMADCTL_1_column);
+            break;
+        case FfxDisplayRotationRibbonLeft:
+            madctl = (CommandMADCTL_1_page_column | CommandMADCTL_1_page);
+            break;
+    }
+
+    const FfxDisplayController *controller = context->controller;
+
+    madctl ^= controller->madctl ^ context->panel.madctl;
+
+    bool exchange = !!(madctl & CommandMADCTL_1_page_column);
+
+    // Mirror whichever address flips the horizontal (logical) axis
+    if (rotation & FfxDisplayRotationMirror) {
+        madctl ^= exchange ? CommandMADCTL_1_page: CommandMADCTL_1_column;
+    }
+
+    uint8_t addressing = madctl ^ controller->madctlInverted;
+    bool mirrorX = !!(addressing & CommandMADCTL_1_column);
+    bool mirrorY = !!(addressing & CommandMADCTL_1_page);
+
+    const FfxDisplayPanel *panel = &context->panel;
+
+    uint16_t gramColumn = panel->columnOffset;
+    if (mirrorX) { gramColumn = controller->gramWidth - panel->width - panel->columnOffset; }
+
+    uint16_t gramRow = panel->rowOffset;
+    if (mirrorY) { gramRow = controller->gramHeight - panel->height - panel->rowOffset; }
+
+    context->width = exchange ? panel->height: panel->width;
+    context->height = exchange ? panel->width: panel->height;
+
+    context->madctl = madctl;
+    context->columnOffset = exchange ? gramRow: gramColumn;
+    context->rowOffset = exchange ? gramColumn: gramRow;
+
+    context->exchange = exchange;
+    context->mirrorRows = mirrorY;
+}
+
+// The transactions of an initialization sequence, which are queued
+// back-to-back until a wait (the D/C pin is still set per transaction
+// by the pre-transfer callback)
+typedef struct _Batch {
+    spi_transaction_t transactions[TRANSACTION_COUNT];
+    uint32_t count;
+} _Batch;
+
+static void st7789_batch_flush(_Context *context, _Batch *batch) {
+    for (uint32_t i = 0; i < batch->count; i++) {
+        spi_transaction_t *transaction;
+        esp_err_t result = spi_device_get_trans_result(context->spi,
+          &transaction, portMAX_DELAY);
+        assert(result == ESP_OK);
+    }
+    batch->count = 0;
+}
+
+// Queue a transaction; short data is copied, otherwise it must remain
+// valid until the batch is flushed
+static void st7789_batch_send(_Context *context, _Batch *batch,
+  MessageType dc, const uint8_t *data, int length) {
+
+    if (length == 0) { return; }
+
+    if (batch->count == TRANSACTION_COUNT) { st7789_batch_flush(context, batch); }
+
+    spi_transaction_t *transaction = &batch->transactions[batch->count];
+    memset(transaction, 0, sizeof(spi_transaction_t));
+    if (length <= 4) {
+        transaction->flags = SPI_TRANS_USE_TXDATA;
+        memcpy(transaction->tx_data, data, length);
+    } else {
+        transaction->tx_buffer = data;
+    }
+    transaction->length = 8 * length;
+    transaction->user = st7789_wrapTransaction(context, dc);
+
+    esp_err_t result = spi_device_queue_trans(context->spi, transaction,
+      portMAX_DELAY);
+    assert(result == ESP_OK);
+
+    batch->count++;
+}
+
+// Send a sequence of commands (see FFX_DISPLAY_INIT_DONE)
+static void st7789_runSequence(_Context *context, const uint8_t *sequence) {
+    const FfxDisplayController *controller = context->controller;
+
+    _Batch batch = { 0 };
 
     uint32_t cmdIndex = 0;
     while (true) {
-        uint8_t cmd = st7789_init_sequence[cmdIndex++];
+        uint8_t cmd = sequence[cmdIndex++];
 
         // Wait psedo-command...
         if (cmd == CommandWait) {
-            delay(st7789_init_sequence[cmdIndex++]);
+            st7789_batch_flush(context, &batch);
+            delay(sequence[cmdIndex++]);
             continue;
         }
 
         if (cmd == CommandResetPin) {
-            gpio_set_level(context->pinReset, st7789_init_sequence[cmdIndex++]);
+            st7789_batch_flush(context, &batch);
+            gpio_set_level(context->pinReset, sequence[cmdIndex++]);
             continue;
         }
 
         // Done psedo-command...
         if (cmd == CommandDone) { break; }
 
-        st7789_send(context, MessageTypeCommand, &cmd, 1);
-
-        // ST7789 command + parameters
-        uint8_t paramCount = st7789_init_sequence[cmdIndex++];
-
-        // Setting the Addressing requires injecting the screen rotation.
-        // We only support 2 rotations for now, since they can be managed
-        // exclusively with setup commands; other modes require adjusting
-        // the offsets of memory writes, since the 320x240 memory only
-        // uses 240x240, so the 80x240 pixels that are not shown differ
-        // depending on the rotation.
-        if (cmd == CommandMADCTL) {
-            uint8_t operand = 0;
-            switch (rotation) {
-                case FfxDisplayRotationRibbonBottom:
-                    operand = 0;
-                    break;
-                case FfxDisplayRotationRibbonRight:
-                    operand = (CommandMADCTL_1_page_column | CommandMADCTL_1_column);
-                    break;
-            }
-            st7789_send(context, MessageTypeData, &operand, 1);
+        // Escape psedo-command; the command collides with a psedo-command
+        if (cmd == CommandEscape) { cmd = sequence[cmdIndex++]; }
+
+        st7789_batch_send(context, &batch, MessageTypeCommand, &cmd, 1);
+
+        // Controller command + parameters
+        uint8_t paramCount = sequence[cmdIndex++];
+
+        // Setting the Addressing and the column window requires
+        // injecting the screen rotation (see st7789_setRotation); the
+        // row window is set per fragment.
+        if (cmd == controller->commandMADCTL) {
+            st7789_batch_send(context, &batch, MessageTypeData, &context->madctl, 1);
+
+        } else if (cmd == controller->commandCASET) {
+            uint16_t x0 = context->columnOffset;
+            uint16_t x1 = context->columnOffset + context->width - 1;
+            uint8_t window[4] = { x0 >> 8, x0 & 0xff, x1 >> 8, x1 & 0xff };
+            st7789_batch_send(context, &batch, MessageTypeData, window, 4);
 
         } else {
-            st7789_send(context, MessageTypeData, &st7789_init_sequence[cmdIndex], paramCount);
+            st7789_batch_send(context, &batch, MessageTypeData,
+              &sequence[cmdIndex], paramCount);
         }
 
         cmdIndex += paramCount;
     }
+
+    st7789_batch_flush(context, &batch);
+}
+
+// Initialize all pins and send the initialization sequence to the display
+static void st7789_init(_Context *context) {
+    // Initialize non-SPI GPIOs (this is critical, especially if one of these pins is
+    // part of the native SPI pins, even if the signal is set to -1)
+    gpio_reset_pin(context->pinDC);
+    gpio_reset_pin(context->pinReset);
+
+    gpio_set_direction(context->pinDC, GPIO_MODE_OUTPUT);
+    gpio_set_direction(context->pinReset, GPIO_MODE_OUTPUT);
+
+    // if (NO_CS_PIN) {
+    //     gpio_set_direction(10, GPIO_MODE_OUTPUT);
+    //     gpio_set_level(10, 0);
+    // }
+
+    st7789_runSequence(context, context->controller->initSequence);
+
+    if (context->panel.initOverrides) {
+        st7789_runSequence(context, context->panel.initOverrides);
+    }
 }
 
-// Asynchronously send a fragment (240 x FRAGMENT_HEIGHT) to the
-// display using DMA. This will return immediately, and a call to
-// the st7789_await_fragment function is required to the wait
-// for these transactions to complete. Between the calls to
-// st7789_asend_fragment and st7789_await_fragment the CPU is
-// free to perform other tasks.
-static void st7789_asend_fragment(_Context *context) {
+// Returns the frame memory row address of the row y, and limits count
+// to the rows which follow it contiguously in the frame memory
+static uint32_t st7789_mapRows(_Context *context, uint32_t y, uint32_t *count) {
+    if (context->flipping) {
+        uint32_t bandY = context->bandY;
+        uint32_t bandEnd = bandY + context->bandHeight;
+
+        if (y < bandY) {
+            if (y + *count > bandY) { *count = bandY - y; }
+
+        } else if (y < bandEnd) {
+            if (y + *count > bandEnd) { *count = bandEnd - y; }
+            return context->pageAddresses[!context->page] + (y - bandY);
+        }
+
+        return context->rowOffset + y;
+    }
+
+    if (!context->scrolling) { return context->rowOffset + y; }
+
+    uint32_t row = (y + context->scroll) % context->height;
+    if (row + *count > context->height) { *count = context->height - row; }
+    return context->rowOffset + row;
+}
 
-    // The current y position
-    uint32_t y = context->currentY;
-    context->transactions[1].tx_data[0] = y >> 8;                           // Start row (high)
-    context->transactions[1].tx_data[1] = y & 0xff;                         // start row (low)
-    context->transactions[1].tx_data[2] = (y + FfxDisplayFragmentHeight - 1) >> 8;    // End row (high)
-    context->transactions[1].tx_data[3] = (y + FfxDisplayFragmentHeight - 1) & 0xff;  // End row (low)
+// Asynchronously send rows of a fragment (width x rows) at y0 to the
+// display using DMA. This will
+// return immediately, and a call to the st7789_await_fragment function
+// is required to the wait for these transactions to complete. Between
+// the calls to st7789_asend_fragment and st7789_await_fragment the CPU
+// is free to perform other tasks.
+static void st7789_asend_fragment(_Context *context, uint32_t y0,
+  uint32_t rows, const uint16_t *fragment) {
+
+    spi_transaction_t *transactions = context->transactions;
+    context->pendingTransactions = 0;
+    context->inflightY = y0;
+
+    bool frameEnd = (y0 + rows >= context->spanY + context->spanHeight);
+
+    uint32_t window = 0;
+    while (rows) {
+        assert(context->pendingTransactions < TRANSACTION_COUNT);
+
+        // The frame memory row (and how many rows follow it contiguously)
+        uint32_t count = rows;
+        uint32_t y = st7789_mapRows(context, y0, &count);
+
+        transactions[1].tx_data[0] = y >> 8;                          // Start row (high)
+        transactions[1].tx_data[1] = y & 0xff;                        // start row (low)
+        transactions[1].tx_data[2] = (y + count - 1) >> 8;            // End row (high)
+        transactions[1].tx_data[3] = (y + count - 1) & 0xff;          // End row (low)
+
+        // Fragment data; the last window completes the fragment
+        transactions[3].tx_buffer = fragment;
+        transactions[3].length = context->width * 8 * 2 * count;
+        transactions[3].user = st7789_wrapTransaction(context, MessageTypeData);
+        if (count == rows) {
+            transactions[3].user = (void*)((int)transactions[3].user |
+              USER_LAST | (window << USER_WINDOW_SHIFT) |
+              (frameEnd ? USER_FRAME_END: 0));
+        }
 
-    // Fragment data
-    context->transactions[3].tx_buffer = context->fragments[context->inflightFragment];
+        // Queue and send (asynchronously) all command and data transactions for this window
+        for (int i = 0; i < 4; i++) {
+           esp_err_t result = spi_device_queue_trans(context->spi, &(transactions[i]), portMAX_DELAY);
+           assert(result == ESP_OK);
+            // DEBUG: SYNC; comment onut await calls
+            //esp_err_t result = spi_device_polling_transmit(context->spi, &(transactions[i]));
+            //assert(result == ESP_OK);
+        }
+        context->pendingTransactions += 4;
 
-    // Queue and send (asynchronously) all command and data transactions for this fragment
-    for (int i = 0; i < 4; i++) {
-       esp_err_t result = spi_device_queue_trans(context->spi, &(context->transactions[i]), portMAX_DELAY);
-       assert(result == ESP_OK);
-        // DEBUG: SYNC; comment onut await calls
-        //esp_err_t result = spi_device_polling_transmit(context->spi, &(context->transactions[i]));
-        //assert(result == ESP_OK);
+        transactions += 4;
+        window++;
+        fragment += context->width * count;
+        y0 += count;
+        rows -= count;
     }
 }
 
@@ -267,204 +806,1567 @@ static void st7789_await_fragment(_Context *context) {
 
     // Wait for all in-flight transactions are done
     spi_transaction_t *transaction;
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < context->pendingTransactions; i++) {
         esp_err_t result = spi_device_get_trans_result(context->spi, &transaction, portMAX_DELAY);
         assert(result == ESP_OK);
     }
+    context->pendingTransactions = 0;
 }
 
-// Initialize the display driver for the ST7789 on a SPI bus. This
-// requires using malloc because the memory acquired must be
-// DMA-compatible.
-FfxDisplayContext ffx_display_init(FfxDisplaySpiBus spiBus, uint8_t pinDC,
-  uint8_t pinReset, FfxDisplayRotation rotation, FfxRenderFunc renderFunc,
-  void *renderContext) {
-
-    // Check the dimensions are safe (the #error checks this too)
-    assert((DISPLAY_HEIGHT % FfxDisplayFragmentHeight) == 0);
-
-    _Context *context = malloc(sizeof(_Context));
-    memset(context, 0, sizeof(_Context));
-    for (int i = 0; i < 2; i++) {
-        size_t byteCount = DISPLAY_WIDTH * FfxDisplayFragmentHeight * 2;
-        uint8_t *data = heap_caps_malloc(byteCount, MALLOC_CAP_DMA);
-        assert(data != NULL && (((int)(data)) % 4) == 0);
-        memset(data, 0, byteCount);
-        context->fragments[i] = data;
+// Collect the completed transactions, returning true once they all are
+static bool st7789_poll_fragment(_Context *context) {
+    spi_transaction_t *transaction;
+    while (context->pendingTransactions) {
+        esp_err_t result = spi_device_get_trans_result(context->spi, &transaction, 0);
+        if (result != ESP_OK) { return false; }
+        context->pendingTransactions--;
     }
+    return true;
+}
 
-    context->renderFunc = renderFunc;
-    context->context = renderContext;
-
-    context->inflightFragment = -1;
+// The time to scan a line (in ns), or 0 if unknown
+static uint32_t st7789_lineTime(_Context *context) {
+    if (context->pinTe >= 0) { return context->measuredLineTime; }
+    if (context->lineTime) { return context->lineTime; }
+    if (context->frameRate == 0) { return 0; }
 
-    // GPIO pins
-    context->pinDC = pinDC;
-    context->pinReset = pinReset;
+    uint32_t lines = context->scanLines;
+    return 1000000000 / (context->frameRate * lines);
+}
 
-    // Current top Y coordinate to render
-    context->currentY = 0;
+// The time (in us) to wait before sending rows at y0, so the write never
+// crosses the line the panel is scanning out; 0 to send now.
+//
+// Lines are counted from the TE edge. When the panel scans faster than
+// the rows are sent, the write must start far enough ahead of the beam
+// that it is done before the beam (coming back around) catches up;
+// otherwise far enough behind it that the write never overtakes it.
+static uint32_t st7789_beamDelay(_Context *context, uint32_t y0, uint32_t rows) {
+    uint32_t lineTime = st7789_lineTime(context);
+    int64_t vsyncTime = context->vsyncTime;
+    if (!context->racing || lineTime == 0 || vsyncTime == 0) { return 0; }
+
+    uint32_t lines = context->scanLines;
+
+    // The frame memory line of the first row (the flip band and scroll
+    // are accounted for; a wrap is rare enough to ignore)
+    uint32_t count = rows;
+    uint32_t top = BEAM_BLANK_LINES + st7789_mapRows(context, y0, &count);
+
+    uint64_t bits = 16 * context->width * rows;
+    uint32_t sendTime = 1000000 * bits / context->controller->clockSpeed;
+    uint32_t sendLines = (1000 * sendTime + lineTime - 1) / lineTime;
+
+    int64_t now = esp_timer_get_time();
+    uint32_t beam = (1000 * (now - vsyncTime) / lineTime) % lines;
+
+    // The lines until the beam reaches the first row (a full refresh if
+    // it is on it), and the lines it has passed it by
+    uint32_t ahead = (top + lines - beam) % lines;
+    if (ahead == 0) { ahead = lines; }
+    uint32_t behind = lines - ahead;
+
+    uint32_t wait = 0;
+    if (sendLines > rows) {
+        // The beam laps the write before it is done; the race is lost
+        if (sendLines - rows > lines) {
+            context->beamStats.lostRaces++;
+            return 0;
+        }
+        if (ahead < sendLines - rows) { wait = ahead; }
 
-    // Setup the Transaction parameters that are the same (ish) for all display updates
-    for (uint32_t i = 0; i < 4; i++) {
-        memset(&(context->transactions[i]), 0, sizeof(spi_transaction_t));
-        context->transactions[i].rx_buffer = NULL;
-        context->transactions[i].flags = SPI_TRANS_USE_TXDATA;
+    } else if (behind < rows - sendLines) {
+        wait = rows - sendLines - behind;
     }
 
-    // Page Address Set - Command
-    context->transactions[0].length = 8;
-    context->transactions[0].tx_data[0] = CommandRASET;
-    context->transactions[0].user = st7789_wrapTransaction(context, MessageTypeCommand);
+    return (wait * lineTime + 999) / 1000;
+}
 
-    // Page Address Set - Value
-    context->transactions[1].length = 8 * 4;
-    context->transactions[1].user = st7789_wrapTransaction(context, MessageTypeData);
+// Hold the fragment back until the beam is clear of its rows; if it is
+// still not clear after that (e.g. the line time drifted), the race was
+// lost and the fragment is sent anyway
+static void st7789_raceBeam(_Context *context, uint32_t y0, uint32_t rows) {
+    if (!context->racing) { return; }
 
-    // Memory Write - Command
-    context->transactions[2].length = 8;
-    context->transactions[2].tx_data[0] = CommandRAMWR;
-    context->transactions[2].user = st7789_wrapTransaction(context, MessageTypeCommand);
+    FfxDisplayBeamStats *stats = &context->beamStats;
+    stats->fragments++;
 
-    // Memory Write - Value (remove the SPI_TRANS_USE_TXDATA flag)
-    context->transactions[3].length = DISPLAY_WIDTH * 8 * 2 * FfxDisplayFragmentHeight;
-    context->transactions[3].user = st7789_wrapTransaction(context, MessageTypeData);
-    context->transactions[3].flags = 0;
+    uint32_t wait = st7789_beamDelay(context, y0, rows);
+    if (wait == 0) { return; }
 
-    // Get the selected device macro; @TODO: encode this into SPI_BUS
-    spi_host_device_t hostDevice = _DECODE_SPI_BUS_HOST(spiBus);
+    stats->delayed++;
+    stats->delayTime += wait;
+    sleepUntil(context, esp_timer_get_time() + wait);
 
-    // Bus Configuration
-    {
-        spi_bus_config_t busConfig = {
-            .miso_io_num = -1,    // _DECODE_SPI_BUS_MISO(spiBus),
-            .mosi_io_num = _DECODE_SPI_BUS_MOSI(spiBus),
-            .sclk_io_num = _DECODE_SPI_BUS_SCLK(spiBus),
-            .max_transfer_sz = FfxDisplayFragmentHeight * DISPLAY_WIDTH * 2 + 8,
-            .quadwp_io_num = -1,
-            .quadhd_io_num = -1,
-            .flags = 0
-        };
+    if (st7789_beamDelay(context, y0, rows)) { stats->lostRaces++; }
+}
 
-        //printf("[disp] SPI Bus: MOSI=%d, CLK=%d\n", busConfig.mosi_io_num, busConfig.sclk_io_num);
+// Send the fragment (to the display and its mirrors) in the backbuffer
+static void st7789_send_fragment(_Bus *bus, _Context *context,
+  int8_t backbufferFragment, uint32_t y0, uint32_t rows) {
 
-        esp_err_t result = spi_bus_initialize(hostDevice, &busConfig, SPI_DMA_CH_AUTO);
-        assert(result == ESP_OK);
-    }
+    st7789_raceBeam(context, y0, rows);
 
-    // Device Interface Configuration
-    spi_device_interface_config_t devConfig = {
-        .clock_speed_hz = SPI_MASTER_FREQ_40M,           // Clock out at 40 MHz
+    bus->inflightFragment = backbufferFragment;
+    bus->inflight = context;
 
-        // For ST7789 w/ a CS pin, which needs to be pulled low
-        .mode = 0,                                       // SPI mode 0 (CPOL = 0, CPHA = 0)
-        .spics_io_num = _DECODE_SPI_BUS_CS0(spiBus),     // CS pin (Chip Select)
+    const uint16_t *fragment = bus->fragments[backbufferFragment];
+    for (_Context *display = context; display; display = display->mirror) {
+        st7789_asend_fragment(display, y0, rows, fragment);
+    }
+}
 
-        .queue_size = 7,                                 // Allow 7 in-flight transactions
-        .pre_cb = st7789_spi_pre_transfer_callback,      // Handles the D/C gpio (Data/Command)
-        .flags = 0 //SPI_DEVICE_NO_DUMMY,
-    };
+// Without blocking, retire the fragment on the wire if it is complete,
+// and then send any staged fragment; returns true if the bus is idle
+static bool st7789_poll_bus(_Bus *bus) {
+    if (bus->inflight) {
+        for (_Context *context = bus->inflight; context; context = context->mirror) {
+            if (!st7789_poll_fragment(context)) { return false; }
+        }
+        bus->inflight = NULL;
+        bus->inflightFragment = -1;
+    }
 
-    // For ST7789 w/o a CS (i.e. pulled to ground)
-    //if (NO_CS_PIN) {
+    if (bus->staged) {
+        // Not yet; the beam is on its rows
+        if (st7789_beamDelay(bus->staged, bus->stagedY, bus->stagedRows)) {
+            return false;
+        }
 
-    // SPI mode 3 (CPOL = 1, CPHA = 1)
-    devConfig.mode = 3;
+        st7789_send_fragment(bus, bus->staged, bus->stagedFragment,
+          bus->stagedY, bus->stagedRows);
+        bus->staged = NULL;
+        return false;
+    }
 
-    // CS pin (not used)
-    devConfig.spics_io_num = -1;
+    return true;
+}
 
-    //}
+// Wait for the fragment on the wire (of any display, and its mirrors)
+// to complete, and any staged fragment after it
+static void st7789_await_bus(_Bus *bus) {
+    while (bus->inflight) {
+        for (_Context *context = bus->inflight; context; context = context->mirror) {
+            st7789_await_fragment(context);
+        }
+        bus->inflight = NULL;
+        bus->inflightFragment = -1;
 
-    // Create a low-speed SPI device for initialization
-    esp_err_t result = spi_bus_add_device(hostDevice, &devConfig, &(context->spi));
-    assert (result == ESP_OK);
+        if (bus->staged) {
+            st7789_send_fragment(bus, bus->staged, bus->stagedFragment,
+              bus->stagedY, bus->stagedRows);
+            bus->staged = NULL;
+        }
+    }
+}
 
-    // if (NO_CS_PIN) {
-    //     gpio_reset_pin(10);
-    //     gpio_set_direction(10, GPIO_MODE_OUTPUT);
-    //     gpio_set_level(10, 0);
-    //     delay(10);
-    // }
+// Wait for an asynchronous initialization to complete
+static void st7789_awaitReady(_Context *context) {
+    if (context->ready) { return; }
+    xEventGroupWaitBits(context->readyEvents, READY_BIT, pdFALSE, pdTRUE,
+      portMAX_DELAY);
+}
 
-    // Initialize the display controller (with the low-speed SPI device)
-    st7789_init(context, rotation);
+static _Bus *buses[SPI_HOST_MAX] = { 0 };
 
-    // Remove the low-speed SPI and replace it with a high-speed one
-    result = spi_bus_remove_device(context->spi);
-    assert (result == ESP_OK);
+// The transfer limits of buses initialized by another component (see
+// ffx_display_setSpiBusLimit); 0 for SPI_DEFAULT_MAX_TRANSFER
+static size_t busLimits[SPI_HOST_MAX] = { 0 };
 
-    // Probably not necessary; ensure the old low-speed SPI device does not interfere with the new high-speed one
-    memset(&(context->spi), 0, sizeof(spi_device_handle_t));
+static void st7789_releaseBus(_Bus *bus) {
+    bus->refCount--;
+    if (bus->refCount) { return; }
 
-    // Now configure a high-speed SPI interface for sending fragments
-    devConfig.clock_speed_hz = SPI_MASTER_FREQ_80M;
-    result = spi_bus_add_device(hostDevice, &devConfig, &(context->spi));
-    assert (result == ESP_OK);
+    heap_caps_free(bus->fragments[0]);
+    heap_caps_free(bus->fragments[1]);
 
-    // Bookkeeping for statistics
-    context->frame = 0;
-    context->frameCount = 0;
-    context->t0 = ticks();
+    if (!bus->external) { spi_bus_free(bus->host); }
 
-    return context;
+    buses[bus->host] = NULL;
+    free(bus);
 }
 
-// 565  5 3   3 5
-//#define RGB_HI(V)  (((V) & 0xf8) | ((V) & 0xfc) >> 5)
-//#define RGB_LO(V)  ((((V) & 0xfc) << 3) | ((V) & 0xf8) >> 3)
+// Attach a display to the bus for its SPI host, initializing the bus
+// for the first display and growing the shared fragments to fit. This
+// requires using heap_caps_malloc because the fragments must be
+// DMA-compatible. Returns NULL if the display cannot share the bus.
+static _Bus* st7789_acquireBus(FfxDisplaySpiBus spiBus, size_t fragmentSize,
+  bool nocs) {
 
-// Release the resources for this display driver
-void ffx_display_free(FfxDisplayContext context) {
-    heap_caps_free(((_Context*)context)->fragments[0]);
-    heap_caps_free(((_Context*)context)->fragments[1]);
-    free(context);
-}
+    spi_host_device_t host = _DECODE_SPI_BUS_HOST(spiBus);
+    if (host >= SPI_HOST_MAX) { return NULL; }
 
-uint16_t ffx_display_fps(FfxDisplayContext _context) {
-    _Context *context = _context;
-    if (!context) { return 0; }
-    return context->fps;
-}
+    _Bus *bus = buses[host];
 
-// Render a fragment against the scene graph. This and the scene graph handles
-// snapshots of its state so it can be updated freely.
-uint32_t ffx_display_renderFragment(FfxDisplayContext _context) {
+    // An init task is rendering into (and sending) the fragments, which
+    // may be grown below, so let it finish
+    if (bus) {
+        _Context *initializing = bus->initializing;
+        if (initializing) { st7789_awaitReady(initializing); }
+    }
 
-    _Context *context = _context;
+    if (bus == NULL) {
+        bus = malloc(sizeof(_Bus));
+        if (bus == NULL) { return NULL; }
+        memset(bus, 0, sizeof(_Bus));
 
-    context->frame++;
+        bus->host = host;
+        bus->inflightFragment = -1;
 
-    // Advance the fragment starting Y
-    uint32_t y0 = context->currentY;
+        spi_bus_config_t busConfig = {
+            .miso_io_num = -1,    // _DECODE_SPI_BUS_MISO(spiBus),
+            .mosi_io_num = _DECODE_SPI_BUS_MOSI(spiBus),
+            .sclk_io_num = _DECODE_SPI_BUS_SCLK(spiBus),
+            .max_transfer_sz = fragmentSize + 8,
+            .quadwp_io_num = -1,
+            .quadhd_io_num = -1,
+            .flags = 0
+        };
 
-    // Select the free fragment (keep in mind inflightFragment can be -1, 0, or 1)
-    uint8_t backbufferFragment = (context->inflightFragment == 0) ? 1: 0;
+        //printf("[disp] SPI Bus: MOSI=%d, CLK=%d\n", busConfig.mosi_io_num, busConfig.sclk_io_num);
 
-    //scene_render(scene, context->fragments[backbufferFragment], y0, DisplayFragmentHeight);
-    context->renderFunc(context->fragments[backbufferFragment], y0, context->context);
+        esp_err_t result = spi_bus_initialize(host, &busConfig, SPI_DMA_CH_AUTO);
+        if (result == ESP_OK) {
+            bus->maxTransfer = busConfig.max_transfer_sz;
+
+        } else if (result == ESP_ERR_INVALID_STATE) {
+            // Already initialized (e.g. shared with an SD card); the
+            // transfer limit is up to its owner, so unless it was given
+            // assume the driver default. The owner's devices are selected
+            // by their CS pins, so a CS tied low cannot share it
+            bus->external = true;
+            bus->maxTransfer = busLimits[host];
+            if (bus->maxTransfer == 0) { bus->maxTransfer = SPI_DEFAULT_MAX_TRANSFER; }
+
+            if (nocs || fragmentSize + 8 > bus->maxTransfer) {
+                free(bus);
+                return NULL;
+            }
+
+        } else {
+            free(bus);
+            return NULL;
+        }
+
+        buses[host] = bus;
 
-    // Wait for the previous (if any; first time does not) transactions to complete
-    if (context->inflightFragment != -1) {
-        st7789_await_fragment(context);
+    } else if (nocs || bus->nocs || fragmentSize + 8 > bus->maxTransfer) {
+        // Displays sharing a bus are selected by their CS pins, and the
+        // transfer limit is fixed when the bus is initialized
+        return NULL;
     }
 
-    // Swap inflight with backbuffer fragments
-    context->inflightFragment = backbufferFragment;
+    bus->refCount++;
 
-    // Send the new fragment we just generated in the backbuffer (asynchronously)
-    st7789_asend_fragment(context);
+    // Grow the shared fragments; any fragment on the wire must complete
+    // before its buffer is released
+    if (fragmentSize > bus->fragmentSize) {
+        uint16_t *fragments[2];
+        for (int i = 0; i < 2; i++) {
+            fragments[i] = heap_caps_malloc(fragmentSize, MALLOC_CAP_DMA);
+        }
 
-    context->currentY += FfxDisplayFragmentHeight;
+        if (fragments[0] == NULL || fragments[1] == NULL) {
+            heap_caps_free(fragments[0]);
+            heap_caps_free(fragments[1]);
+            st7789_releaseBus(bus);
+            return NULL;
+        }
 
-    // The last fragment...
-    if (context->currentY == DISPLAY_HEIGHT) {
-        context->currentY = 0;
+        st7789_await_bus(bus);
 
-        // Update statistics and optionally dump them to the terminal
-        context->frameCount++;
+        for (int i = 0; i < 2; i++) {
+            assert((((int)(fragments[i])) % 4) == 0);
+            memset(fragments[i], 0, fragmentSize);
+            heap_caps_free(bus->fragments[i]);
+            bus->fragments[i] = fragments[i];
+        }
+        bus->fragmentSize = fragmentSize;
+    }
 
-        // Update the FPS stats every 1s
+    bus->nocs |= nocs;
+
+    return bus;
+}
+
+void ffx_display_setSpiBusLimit(FfxDisplaySpiBus spiBus, size_t maxTransfer) {
+    spi_host_device_t host = _DECODE_SPI_BUS_HOST(spiBus);
+    if (host >= SPI_HOST_MAX) { return; }
+    busLimits[host] = maxTransfer;
+}
+
+// Create the display driver for a controller on a SPI bus; the
+// controller must then be initialized (see st7789_init)
+static _Context* st7789_create(FfxDisplaySpiBus spiBus,
+  uint8_t pinDC, uint8_t pinReset, const FfxDisplayPanel *panel,
+  FfxDisplayRotation rotation, FfxRenderFunc renderFunc,
+  void *renderContext) {
+
+    int64_t initStart = esp_timer_get_time();
+
+    const FfxDisplayController *controller = panel->controller;
+    if (controller == NULL) { controller = &FfxDisplayControllerST7789; }
+
+    // The visible region must be within the frame memory
+    if (panel->width == 0 || panel->height == 0) { return NULL; }
+    if (panel->columnOffset + panel->width > controller->gramWidth) { return NULL; }
+    if (panel->rowOffset + panel->height > controller->gramHeight) { return NULL; }
+
+    _Context *context = malloc(sizeof(_Context));
+    if (context == NULL) { return NULL; }
+    memset(context, 0, sizeof(_Context));
+
+    context->panel = *panel;
+    context->controller = controller;
+    context->initStart = initStart;
+
+    // Compute the rotated size, which the fragments are sized from
+    st7789_setRotation(context, rotation);
+
+    context->fragmentHeight = panel->fragmentHeight ? panel->fragmentHeight: FRAGMENT_HEIGHT;
+    if (context->fragmentHeight > context->height) {
+        context->fragmentHeight = context->height;
+    }
+    context->fragmentCount = (context->height + context->fragmentHeight - 1) / context->fragmentHeight;
+
+    context->fragmentTimes = calloc(context->fragmentCount, sizeof(int64_t));
+    if (context->fragmentTimes == NULL) {
+        free(context);
+        return NULL;
+    }
+
+    size_t fragmentSize = context->width * context->fragmentHeight * 2;
+
+    // A CS pin of 0 is a CS tied low (see the _nocs buses)
+    int pinCS = _DECODE_SPI_BUS_CS0(spiBus);
+
+    context->bus = st7789_acquireBus(spiBus, fragmentSize, pinCS == 0);
+    if (context->bus == NULL) {
+        free((void*)context->fragmentTimes);
+        free(context);
+        return NULL;
+    }
+
+    context->renderFunc = renderFunc;
+    context->context = renderContext;
+
+    // GPIO pins
+    context->pinDC = pinDC;
+    context->pinReset = pinReset;
+    context->pinTe = -1;
+
+    // Copied, since the TE interrupt cannot read the controller
+    context->scanLines = controller->gramHeight + BEAM_BLANK_LINES;
+
+    // Current top Y coordinate to render
+    context->currentY = 0;
+
+    // Frames span the whole display (until partial mode is enabled)
+    context->spanY = 0;
+    context->spanHeight = context->height;
+
+    // Setup the Transaction parameters that are the same (ish) for all display updates
+    for (uint32_t i = 0; i < TRANSACTION_COUNT; i++) {
+        memset(&(context->transactions[i]), 0, sizeof(spi_transaction_t));
+        context->transactions[i].rx_buffer = NULL;
+        context->transactions[i].flags = SPI_TRANS_USE_TXDATA;
+    }
+
+    for (uint32_t i = 0; i < TRANSACTION_COUNT; i += 4) {
+        spi_transaction_t *transactions = &context->transactions[i];
+
+        // Page Address Set - Command
+        transactions[0].length = 8;
+        transactions[0].tx_data[0] = controller->commandRASET;
+        transactions[0].user = st7789_wrapTransaction(context, MessageTypeCommand);
+
+        // Page Address Set - Value
+        transactions[1].length = 8 * 4;
+        transactions[1].user = st7789_wrapTransaction(context, MessageTypeData);
+
+        // Memory Write - Command
+        transactions[2].length = 8;
+        transactions[2].tx_data[0] = controller->commandRAMWR;
+        transactions[2].user = st7789_wrapTransaction(context, MessageTypeCommand);
+
+        // Memory Write - Value (remove the SPI_TRANS_USE_TXDATA flag); the
+        // length is set per window
+        transactions[3].length = 8 * fragmentSize;
+        transactions[3].user = st7789_wrapTransaction(context, MessageTypeData);
+        transactions[3].flags = 0;
+    }
+
+    spi_host_device_t hostDevice = context->bus->host;
+
+    // Device Interface Configuration
+    spi_device_interface_config_t devConfig = {
+        .clock_speed_hz = controller->clockSpeed,
+
+        // For a controller w/ a CS pin, which needs to be pulled low
+        .mode = 0,                                       // SPI mode 0 (CPOL = 0, CPHA = 0)
+        .spics_io_num = pinCS,                           // CS pin (Chip Select)
+
+        .queue_size = TRANSACTION_COUNT,                 // Allow a whole fragment in-flight
+        .pre_cb = st7789_spi_pre_transfer_callback,      // Handles the D/C gpio (Data/Command)
+        .post_cb = st7789_spi_post_transfer_callback,    // Notifies completed fragments
+        .flags = 0 //SPI_DEVICE_NO_DUMMY,
+    };
+
+    // For a controller w/o a CS (i.e. pulled to ground)
+    if (pinCS == 0) {
+
+        // SPI mode 3 (CPOL = 1, CPHA = 1)
+        devConfig.mode = 3;
+
+        // CS pin (not used)
+        devConfig.spics_io_num = -1;
+    }
+
+    // The command write cycle of these controllers is the same as for
+    // memory writes, so one device is used for initialization and for
+    // fragments (rather than a separate low-speed device)
+    esp_err_t result = spi_bus_add_device(hostDevice, &devConfig, &(context->spi));
+    if (result != ESP_OK) {
+        // e.g. the host has no CS lines left
+        st7789_releaseBus(context->bus);
+        free((void*)context->fragmentTimes);
+        free(context);
+        return NULL;
+    }
+
+    // if (NO_CS_PIN) {
+    //     gpio_reset_pin(10);
+    //     gpio_set_direction(10, GPIO_MODE_OUTPUT);
+    //     gpio_set_level(10, 0);
+    //     delay(10);
+    // }
+
+    // Bookkeeping for statistics
+    context->frame = 0;
+    context->frameCount = 0;
+
+    return context;
+}
+
+// Initialize the display driver for a controller on a SPI bus.
+FfxDisplayContext ffx_display_initPanel(FfxDisplaySpiBus spiBus,
+  uint8_t pinDC, uint8_t pinReset, const FfxDisplayPanel *panel,
+  FfxDisplayRotation rotation, FfxRenderFunc renderFunc,
+  void *renderContext) {
+
+    _Context *context = st7789_create(spiBus, pinDC, pinReset, panel,
+      rotation, renderFunc, renderContext);
+    if (context == NULL) { return NULL; }
+
+    // Initialize the display controller
+    st7789_init(context);
+
+    context->initTime = esp_timer_get_time() - context->initStart;
+    context->t0 = ticks();
+    context->ready = true;
+
+    return context;
+}
+
+FfxDisplayContext ffx_display_init(FfxDisplaySpiBus spiBus, uint8_t pinDC,
+  uint8_t pinReset, FfxDisplayRotation rotation, FfxRenderFunc renderFunc,
+  void *renderContext) {
+
+    return ffx_display_initPanel(spiBus, pinDC, pinReset,
+      &FfxDisplayPanel240x240, rotation, renderFunc, renderContext);
+}
+
+static void st7789_workerTask(void *arg) {
+    _Worker *worker = arg;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (worker->stop) { break; }
+
+        worker->renderFunc(worker->pixels, worker->stride, worker->x0,
+          worker->y0, worker->width, worker->height, worker->context);
+
+        xSemaphoreGive(worker->done);
+    }
+
+    xSemaphoreGive(worker->done);
+    vTaskDelete(NULL);
+}
+
+static void st7789_stopWorker(_Context *context) {
+    _Worker *worker = context->worker;
+    if (worker == NULL) { return; }
+
+    worker->stop = true;
+    xTaskNotifyGive(worker->task);
+    xSemaphoreTake(worker->done, portMAX_DELAY);
+
+    vSemaphoreDelete(worker->done);
+    free(worker);
+
+    context->worker = NULL;
+    context->rectFunc = NULL;
+}
+
+bool ffx_display_setParallelRender(FfxDisplayContext _context,
+  FfxRenderRectFunc renderFunc, FfxDisplaySplit split) {
+
+    _Context *context = _context;
+
+    st7789_awaitReady(context);
+    st7789_stopWorker(context);
+
+    if (renderFunc == NULL) { return true; }
+
+#if portNUM_PROCESSORS > 1
+    _Worker *worker = malloc(sizeof(_Worker));
+    if (worker == NULL) { return false; }
+    memset(worker, 0, sizeof(_Worker));
+
+    worker->renderFunc = renderFunc;
+    worker->context = context->context;
+
+    worker->done = xSemaphoreCreateBinary();
+    if (worker->done == NULL) {
+        free(worker);
+        return false;
+    }
+
+    // The worker runs on the other core, at the same priority
+    BaseType_t result = xTaskCreatePinnedToCore(st7789_workerTask,
+      "ffx-render", 4096, worker, uxTaskPriorityGet(NULL), &worker->task,
+      !xPortGetCoreID());
+    if (result != pdPASS) {
+        vSemaphoreDelete(worker->done);
+        free(worker);
+        return false;
+    }
+
+    context->worker = worker;
+    context->rectFunc = renderFunc;
+    context->split = split;
+
+    return true;
+#else
+    (void)split;
+    return false;
+#endif
+}
+
+// Track the render time of the fragment at y0
+static void st7789_recordCost(_Context *context, uint32_t y0, uint32_t cost) {
+    context->frameRenderTime += cost;
+
+    if (cost > context->frameWorstCost) {
+        context->frameWorstCost = cost;
+        context->frameWorstY = y0;
+    }
+
+    uint32_t index = (y0 - context->spanY) / context->fragmentHeight;
+    if (context->fragmentCosts && y0 >= context->spanY && index < context->fragmentCount) {
+        context->fragmentCosts[index] = cost;
+    }
+}
+
+// Render the fragment at y0 into pixels; in parallel, the worker renders
+// the second half while this core renders the first, and both are done
+// before returning (and so before the fragment is sent)
+static void st7789_render(_Context *context, uint16_t *pixels, uint32_t y0) {
+    int64_t start = esp_timer_get_time();
+
+    _Worker *worker = context->worker;
+    if (worker == NULL) {
+        context->renderFunc(pixels, y0, context->context);
+        st7789_recordCost(context, y0, esp_timer_get_time() - start);
+        return;
+    }
+
+    uint32_t width = context->width;
+
+    // The last fragment may extend past the bottom, which is not sent
+    uint32_t height = context->fragmentHeight;
+    if (height > context->height - y0) { height = context->height - y0; }
+
+    // Split on an even column, so each half starts 4-byte aligned
+    uint32_t x1 = 0, y1 = 0, width0 = width, height0 = height;
+    if (context->split == FfxDisplaySplitColumns) {
+        width0 = (width / 2) & ~1;
+        x1 = width0;
+    } else {
+        height0 = height / 2;
+        y1 = height0;
+    }
+
+    worker->pixels = &pixels[y1 * width + x1];
+    worker->stride = width;
+    worker->x0 = x1;
+    worker->y0 = y0 + y1;
+    worker->width = width - x1;
+    worker->height = height - y1;
+    xTaskNotifyGive(worker->task);
+
+    // A single row split by rows is rendered entirely by the worker
+    if (height0) {
+        context->rectFunc(pixels, width, 0, y0, width0, height0, context->context);
+    }
+
+    xSemaphoreTake(worker->done, portMAX_DELAY);
+
+    st7789_recordCost(context, y0, esp_timer_get_time() - start);
+}
+
+// Release the resources for this display driver
+void ffx_display_free(FfxDisplayContext _context) {
+    _Context *context = _context;
+
+    st7789_awaitReady(context);
+    st7789_stopWorker(context);
+
+    free(context->fragmentCosts);
+
+    if (context->racing && context->pinTe >= 0) {
+        gpio_isr_handler_remove(context->pinTe);
+    }
+
+    if (context->primary) { ffx_display_removeMirror(context->primary, context); }
+    while (context->mirror) { ffx_display_removeMirror(context, context->mirror); }
+
+    _Bus *bus = context->bus;
+
+    if (bus->inflight == context || bus->staged == context) {
+        st7789_await_bus(bus);
+    }
+
+    spi_bus_remove_device(context->spi);
+    st7789_releaseBus(bus);
+
+    if (context->readyEvents) { vEventGroupDelete(context->readyEvents); }
+
+    if (context->sleepTimer) { esp_timer_delete(context->sleepTimer); }
+    if (context->sleepDone) { vSemaphoreDelete(context->sleepDone); }
+
+    free((void*)context->fragmentTimes);
+    free(context);
+}
+
+// Wait for any fragment of the display (or its mirrors) on the wire
+static void st7789_await_display(_Context *context) {
+    if (context->primary) { context = context->primary; }
+    _Bus *bus = context->bus;
+    if (bus->inflight == context || bus->staged == context) {
+        st7789_await_bus(bus);
+    }
+}
+
+// Send a command after initialization, once the display has no fragment
+// on the wire
+static void st7789_command(_Context *context, uint8_t cmd,
+  const uint8_t *params, uint32_t paramCount) {
+
+    st7789_awaitReady(context);
+    st7789_await_display(context);
+
+    st7789_send(context, MessageTypeCommand, &cmd, 1);
+    st7789_send(context, MessageTypeData, params, paramCount);
+}
+
+// Define the vertical scroll area, in frame memory lines (which the
+// MADCTL does not affect), and its start
+static void st7789_setScrollArea(_Context *context, uint16_t top,
+  uint16_t height, uint16_t start) {
+
+    uint16_t bottom = context->controller->gramHeight - top - height;
+    uint8_t area[6] = {
+        top >> 8, top & 0xff, height >> 8, height & 0xff,
+        bottom >> 8, bottom & 0xff
+    };
+    st7789_command(context, CommandVSCRDEF, area, 6);
+
+    uint8_t address[2] = { start >> 8, start & 0xff };
+    st7789_command(context, CommandVSCSAD, address, 2);
+}
+
+// Set the vertical scroll start address for a scroll (see st7789_mapRows)
+static void st7789_setScroll(_Context *context, uint16_t scroll) {
+    const FfxDisplayPanel *panel = &context->panel;
+    uint16_t height = context->height;
+
+    // When the row addresses are mirrored, the lines run the other way
+    uint16_t line = context->mirrorRows ? ((height - scroll) % height): scroll;
+    uint16_t start = panel->rowOffset + line;
+
+    // The scroll area is the visible region
+    if (!context->scrolling) {
+        st7789_setScrollArea(context, panel->rowOffset, height, start);
+        context->scrolling = true;
+
+    } else {
+        uint8_t address[2] = { start >> 8, start & 0xff };
+        st7789_command(context, CommandVSCSAD, address, 2);
+    }
+
+    context->scroll = scroll;
+}
+
+bool ffx_display_scroll(FfxDisplayContext _context, int32_t rows) {
+    _Context *context = _context;
+
+    // The scroll area is a range of frame memory lines, so only scrolls
+    // vertically if the rotation does not exchange rows and columns
+    for (_Context *display = context; display; display = display->mirror) {
+        if (display->exchange || display->flipping || display->partial) {
+            return false;
+        }
+    }
+
+    int32_t height = context->height;
+    uint16_t scroll = (((int32_t)context->scroll + rows) % height + height) % height;
+
+    for (_Context *display = context; display; display = display->mirror) {
+        st7789_setScroll(display, scroll);
+    }
+
+    return true;
+}
+
+// Place a band of rows beside frame memory lines which are not visible,
+// which hold the hidden page. A scroll area spanning the band and the
+// hidden lines reveals either page by its start address. Which screen
+// rows the band covers depends on the row mirroring of the rotation.
+static bool st7789_setupFlip(_Context *context, uint16_t bandHeight) {
+    const FfxDisplayPanel *panel = &context->panel;
+    uint16_t height = context->height;
+    uint16_t hiddenBelow = context->controller->gramHeight - panel->rowOffset - height;
+    uint16_t hiddenAbove = panel->rowOffset;
+
+    // The first line of the band and of each page
+    uint16_t bandLine, pageLines[2];
+
+    if (hiddenBelow >= bandHeight) {
+        context->flipTop = panel->rowOffset + height - bandHeight;
+        bandLine = context->flipTop;
+        pageLines[0] = bandLine;
+        pageLines[1] = bandLine + bandHeight;
+
+    } else if (hiddenAbove >= bandHeight) {
+        context->flipTop = panel->rowOffset - bandHeight;
+        bandLine = panel->rowOffset;
+        pageLines[0] = bandLine;
+        pageLines[1] = context->flipTop;
+
+    } else {
+        return false;
+    }
+
+    // Convert to screen rows and row addresses; when the row addresses
+    // are mirrored, the lines run the other way
+    uint16_t gramHeight = context->controller->gramHeight;
+    for (int i = 0; i < 2; i++) {
+        context->pageAddresses[i] = pageLines[i];
+        if (context->mirrorRows) {
+            context->pageAddresses[i] = gramHeight - pageLines[i] - bandHeight;
+        }
+    }
+
+    context->bandY = bandLine - panel->rowOffset;
+    if (context->mirrorRows) {
+        context->bandY = panel->rowOffset + height - bandLine - bandHeight;
+    }
+
+    context->bandHeight = bandHeight;
+    context->page = 0;
+
+    return true;
+}
+
+// Reveal the hidden page (once its fragments are complete)
+static void st7789_flipPage(_Context *context) {
+    context->page = !context->page;
+
+    uint16_t start = context->flipTop + (context->page ? context->bandHeight: 0);
+    uint8_t address[2] = { start >> 8, start & 0xff };
+    st7789_command(context, CommandVSCSAD, address, 2);
+}
+
+int32_t ffx_display_enablePageFlip(FfxDisplayContext _context,
+  uint32_t height) {
+
+    _Context *context = _context;
+
+    if (height == 0 || height > context->height) { return -1; }
+
+    for (_Context *display = context; display; display = display->mirror) {
+        if (display->exchange || display->flipping || display->partial) {
+            return -1;
+        }
+        if (display->scrolling && display->scroll) { return -1; }
+        if (!st7789_setupFlip(display, height)) { return -1; }
+
+        // Mirrors share the fragments, so the band must be the same rows
+        if (display->bandY != context->bandY) { return -1; }
+    }
+
+    for (_Context *display = context; display; display = display->mirror) {
+        st7789_setScrollArea(display, display->flipTop, 2 * height,
+          display->flipTop);
+        display->scrolling = false;
+        display->flipping = true;
+    }
+
+    return context->bandY;
+}
+
+void ffx_display_disablePageFlip(FfxDisplayContext _context) {
+    _Context *context = _context;
+
+    for (_Context *display = context; display; display = display->mirror) {
+        if (!display->flipping) { continue; }
+        st7789_setScrollArea(display, 0, display->controller->gramHeight, 0);
+        display->flipping = false;
+    }
+}
+
+void ffx_display_flip(FfxDisplayContext _context) {
+    _Context *context = _context;
+    if (!context->flipping) { return; }
+
+    ffx_display_renderRows(context, context->bandY, context->bandHeight);
+
+    for (_Context *display = context; display; display = display->mirror) {
+        st7789_flipPage(display);
+    }
+}
+
+// Set the partial area to the rows of the span, in frame memory lines;
+// when the row addresses are mirrored, the lines run the other way
+static void st7789_setPartial(_Context *context, uint16_t y0, uint16_t height) {
+    uint16_t start = context->panel.rowOffset + y0;
+    if (context->mirrorRows) {
+        start = context->panel.rowOffset + context->height - y0 - height;
+    }
+    uint16_t end = start + height - 1;
+
+    uint8_t area[4] = { start >> 8, start & 0xff, end >> 8, end & 0xff };
+    st7789_command(context, CommandPTLAR, area, 4);
+    st7789_command(context, CommandPTLON, NULL, 0);
+}
+
+bool ffx_display_enablePartial(FfxDisplayContext _context, uint32_t y0,
+  uint32_t height) {
+
+    _Context *context = _context;
+
+    if (height == 0 || y0 + height > context->height) { return false; }
+
+    // The partial area is a range of frame memory lines
+    for (_Context *display = context; display; display = display->mirror) {
+        if (display->exchange || display->flipping) { return false; }
+        if (display->scrolling && display->scroll) { return false; }
+    }
+
+    for (_Context *display = context; display; display = display->mirror) {
+        st7789_setPartial(display, y0, height);
+        display->partial = true;
+        display->spanY = y0;
+        display->spanHeight = height;
+        display->currentY = y0;
+    }
+
+    return true;
+}
+
+void ffx_display_disablePartial(FfxDisplayContext _context) {
+    _Context *context = _context;
+
+    for (_Context *display = context; display; display = display->mirror) {
+        if (!display->partial) { continue; }
+        st7789_command(display, CommandNORON, NULL, 0);
+        display->partial = false;
+        display->spanY = 0;
+        display->spanHeight = display->height;
+        display->currentY = 0;
+    }
+}
+
+// Set the panel refresh rate of the display and its mirrors, which
+// may have different controllers
+static uint16_t st7789_setFrameRate(_Context *context, uint16_t hz) {
+    for (_Context *display = context; display; display = display->mirror) {
+        const FfxDisplayController *controller = display->controller;
+        if (controller->frameRate == NULL) { continue; }
+
+        uint8_t params[4], paramCount = 0;
+        display->frameRate = controller->frameRate(hz, params, &paramCount);
+        st7789_command(display, controller->commandFrameRate, params, paramCount);
+        display->requestedFrameRate = hz;
+    }
+
+    return context->frameRate;
+}
+
+uint16_t ffx_display_setFrameRate(FfxDisplayContext _context, uint16_t hz) {
+    _Context *context = _context;
+    if (hz == 0 || context->controller->frameRate == NULL) { return 0; }
+
+    context->maxFrameRate = 0;
+    return st7789_setFrameRate(context, hz);
+}
+
+bool ffx_display_setAdaptiveFrameRate(FfxDisplayContext _context,
+  uint16_t minHz, uint16_t maxHz) {
+
+    _Context *context = _context;
+    if (minHz == 0 || minHz > maxHz) { return false; }
+    if (context->controller->frameRate == NULL) { return false; }
+
+    context->minFrameRate = minHz;
+    context->maxFrameRate = maxHz;
+    context->lastFrameTime = ticks();
+
+    // Start fast, as something is likely about to be shown
+    st7789_setFrameRate(context, maxHz);
+
+    return true;
+}
+
+// Raise the refresh rate when frames are being produced quickly, and
+// lower it once they stop
+static void st7789_adaptFrameRate(_Context *context, bool frame) {
+    if (context->maxFrameRate == 0) { return; }
+
+    uint32_t now = ticks();
+    uint32_t dt = now - context->lastFrameTime;
+
+    uint16_t hz = context->requestedFrameRate;
+    if (frame && dt < FRAME_RATE_HOLD) {
+        hz = context->maxFrameRate;
+    } else if (dt >= FRAME_RATE_HOLD) {
+        hz = context->minFrameRate;
+    }
+
+    if (frame) { context->lastFrameTime = now; }
+
+    if (hz != context->requestedFrameRate) { st7789_setFrameRate(context, hz); }
+}
+
+void ffx_display_updateFrameRate(FfxDisplayContext _context) {
+    st7789_adaptFrameRate(_context, false);
+}
+
+bool ffx_display_enableBeamRace(FfxDisplayContext _context, int32_t pinTe,
+  uint32_t lineTime) {
+
+    _Context *context = _context;
+
+    st7789_awaitReady(context);
+
+    // The fragments must be written in the order the panel scans
+    if (context->exchange || context->mirrorRows) { return false; }
+
+    ffx_display_disableBeamRace(context);
+
+    context->pinTe = pinTe;
+    context->lineTime = lineTime;
+    context->measuredLineTime = 0;
+    context->vsyncTime = 0;
+
+    if (pinTe >= 0) {
+        gpio_reset_pin(pinTe);
+        gpio_set_direction(pinTe, GPIO_MODE_INPUT);
+        gpio_set_intr_type(pinTe, GPIO_INTR_POSEDGE);
+
+        // Already installed (e.g. by the app) is fine
+        esp_err_t result = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+        if (result != ESP_OK && result != ESP_ERR_INVALID_STATE) { return false; }
+
+        if (gpio_isr_handler_add(pinTe, st7789_te_isr, context) != ESP_OK) {
+            return false;
+        }
+
+        uint8_t mode = CommandTEON_1_vblank;
+        st7789_command(context, CommandTEON, &mode, 1);
+    }
+
+    context->racing = true;
+
+    return true;
+}
+
+void ffx_display_disableBeamRace(FfxDisplayContext _context) {
+    _Context *context = _context;
+    if (!context->racing) { return; }
+
+    context->racing = false;
+
+    if (context->pinTe >= 0) {
+        gpio_isr_handler_remove(context->pinTe);
+        st7789_command(context, CommandTEOFF, NULL, 0);
+    }
+}
+
+void ffx_display_syncBeam(FfxDisplayContext _context, int64_t time) {
+    _Context *context = _context;
+    context->vsyncTime = time;
+}
+
+void ffx_display_beamStats(FfxDisplayContext _context,
+  FfxDisplayBeamStats *stats, bool reset) {
+
+    _Context *context = _context;
+    *stats = context->beamStats;
+    stats->lineTime = st7789_lineTime(context);
+
+    if (reset) { memset(&context->beamStats, 0, sizeof(FfxDisplayBeamStats)); }
+}
+
+bool ffx_display_addMirror(FfxDisplayContext _context, FfxDisplayContext _mirror) {
+    _Context *context = _context;
+    _Context *mirror = _mirror;
+
+    st7789_awaitReady(context);
+    st7789_awaitReady(mirror);
+
+    // The fragments are rendered once, so must have the same geometry
+    if (mirror == context || context->primary) { return false; }
+    if (mirror->primary || mirror->mirror) { return false; }
+    if (mirror->width != context->width || mirror->height != context->height) {
+        return false;
+    }
+    if (mirror->fragmentHeight != context->fragmentHeight) { return false; }
+
+    st7789_await_display(context);
+    st7789_await_display(mirror);
+
+    mirror->primary = context;
+    mirror->mirror = context->mirror;
+    context->mirror = mirror;
+
+    return true;
+}
+
+void ffx_display_removeMirror(FfxDisplayContext _context, FfxDisplayContext _mirror) {
+    _Context *context = _context;
+    _Context *mirror = _mirror;
+
+    if (mirror->primary != context) { return; }
+
+    st7789_await_display(context);
+
+    _Context **link = &context->mirror;
+    while (*link != mirror) { link = &(*link)->mirror; }
+    *link = mirror->mirror;
+
+    mirror->mirror = NULL;
+    mirror->primary = NULL;
+}
+
+void ffx_display_setPrefetch(FfxDisplayContext _context, FfxPrefetch prefetch) {
+    _Context *context = _context;
+    context->prefetch = prefetch;
+}
+
+void ffx_display_setSnapshot(FfxDisplayContext _context, FfxSnapshot snapshot) {
+    _Context *context = _context;
+    context->snapshot = snapshot;
+}
+
+void ffx_display_setFrameBegin(FfxDisplayContext _context,
+  FfxDisplayFrameFunc frameFunc, void *arg) {
+
+    _Context *context = _context;
+    context->frameBeginFunc = frameFunc;
+    context->frameBeginArg = arg;
+}
+
+void ffx_display_setFrameEnd(FfxDisplayContext _context,
+  FfxDisplayFrameFunc frameFunc, void *arg) {
+
+    _Context *context = _context;
+    context->frameEndFunc = frameFunc;
+    context->frameEndArg = arg;
+}
+
+uint16_t ffx_display_fps(FfxDisplayContext _context) {
+    _Context *context = _context;
+    if (!context) { return 0; }
+    return context->fps;
+}
+
+void ffx_display_setFramePacing(FfxDisplayContext _context, uint16_t fps) {
+    _Context *context = _context;
+    context->pacingFps = fps;
+    context->frameDeadline = 0;
+}
+
+bool ffx_display_setOverrunPolicy(FfxDisplayContext _context,
+  FfxDisplayOverrunPolicy policy, uint32_t budget) {
+
+    _Context *context = _context;
+
+    if (policy == FfxDisplayOverrunSkipFragments && context->fragmentCosts == NULL) {
+        context->fragmentCosts = calloc(context->fragmentCount, sizeof(uint32_t));
+        if (context->fragmentCosts == NULL) { return false; }
+    }
+
+    context->overrunPolicy = policy;
+    context->frameBudget = budget;
+    context->rateDivisor = 1;
+    context->fitFrames = 0;
+    context->skipCost = 0;
+
+    return true;
+}
+
+int32_t ffx_display_addPriorityRegion(FfxDisplayContext _context,
+  uint32_t y0, uint32_t height) {
+
+    _Context *context = _context;
+
+    if (height == 0 || y0 + height > context->height) { return -1; }
+
+    for (int i = 0; i < MAX_PRIORITY_REGIONS; i++) {
+        _Region *region = &context->regions[i];
+        if (region->used) { continue; }
+        region->used = true;
+        region->y0 = y0;
+        region->height = height;
+        return i;
+    }
+
+    return -1;
+}
+
+void ffx_display_removePriorityRegion(FfxDisplayContext _context,
+  int32_t region) {
+
+    _Context *context = _context;
+    if (region < 0 || region >= MAX_PRIORITY_REGIONS) { return; }
+    context->regions[region].used = false;
+}
+
+void ffx_display_setRefreshDivisor(FfxDisplayContext _context,
+  uint16_t divisor) {
+
+    _Context *context = _context;
+    context->refreshDivisor = divisor;
+}
+
+void ffx_display_overrunStats(FfxDisplayContext _context,
+  FfxDisplayOverrunStats *stats, bool reset) {
+
+    _Context *context = _context;
+    *stats = context->overrunStats;
+    stats->rateDivisor = context->rateDivisor ? context->rateDivisor: 1;
+    stats->skipping = (context->skipCost != 0);
+
+    if (reset) { memset(&context->overrunStats, 0, sizeof(FfxDisplayOverrunStats)); }
+}
+
+int64_t ffx_display_frameTime(FfxDisplayContext _context) {
+    _Context *context = _context;
+    return context->frameTime;
+}
+
+uint32_t ffx_display_startupTime(FfxDisplayContext _context,
+  uint32_t *initTime) {
+
+    _Context *context = _context;
+    if (initTime) { *initTime = context->initTime; }
+
+    // Captured without waiting, so ffx_display_submitFragment never blocks
+    if (context->firstFrameTime == 0) {
+        int64_t time = st7789_readTime(&context->firstFrameDone);
+        if (time) { context->firstFrameTime = time - context->initStart; }
+    }
+
+    return context->firstFrameTime;
+}
+
+uint16_t ffx_display_width(FfxDisplayContext _context) {
+    _Context *context = _context;
+    return context->width;
+}
+
+uint16_t ffx_display_height(FfxDisplayContext _context) {
+    _Context *context = _context;
+    return context->height;
+}
+
+uint16_t ffx_display_fragmentHeight(FfxDisplayContext _context) {
+    _Context *context = _context;
+    return context->fragmentHeight;
+}
+
+uint16_t ffx_display_fragmentCount(FfxDisplayContext _context) {
+    _Context *context = _context;
+    return context->fragmentCount;
+}
+
+// Render the fragment at y0 into the backbuffer and send rows of it,
+// while the previous fragment on the bus is on the wire
+static void st7789_renderFragment(_Context *context, uint32_t y0, uint32_t rows) {
+
+    // Select the free fragment (keep in mind inflightFragment can be -1, 0, or 1);
+    // the fragments are shared by all displays on the bus, and a staged
+    // fragment (see ffx_display_submitFragment) occupies the other one
+    _Bus *bus = context->bus;
+    if (bus->staged) { st7789_await_bus(bus); }
+    uint8_t backbufferFragment = (bus->inflightFragment == 0) ? 1: 0;
+
+    //scene_render(scene, context->fragments[backbufferFragment], y0, DisplayFragmentHeight);
+    st7789_render(context, bus->fragments[backbufferFragment], y0);
+
+    // Wait for the previous (if any; first time does not) transactions to
+    // complete, which may be for another display on the bus
+    st7789_await_bus(bus);
+
+    // Swap inflight with backbuffer fragments, and send the new fragment
+    // we just generated in the backbuffer (asynchronously), and the same
+    // buffer to each mirror; on other hosts they are sent in parallel
+    st7789_send_fragment(bus, context, backbufferFragment, y0, rows);
+}
+
+// Draw the splash centered on a black background (clipped if larger)
+static void st7789_renderSplash(uint16_t *pixels, uint32_t y0, void *_context) {
+    _Context *context = _context;
+    const FfxImage *image = &context->splash;
+
+    uint32_t width = context->width;
+    memset(pixels, 0, width * context->fragmentHeight * 2);
+
+    int32_t top = ((int32_t)context->height - image->height) / 2;
+    int32_t left = ((int32_t)width - image->width) / 2;
+    if (left < 0) { left = 0; }
+
+    int32_t y = (int32_t)y0 - top;
+    int32_t rows = context->fragmentHeight;
+    int32_t offset = 0;
+    if (y < 0) {
+        offset = -y;
+        rows += y;
+        y = 0;
+    }
+    if (rows <= 0) { return; }
+
+    ffx_image_decodeRows(image, y, rows, &pixels[offset * width + left], width);
+}
+
+static void st7789_initTask(void *arg) {
+    _Context *context = arg;
+
+    st7789_init(context);
+    context->initTime = esp_timer_get_time() - context->initStart;
+
+    // The panel is on, so show the splash (the app cannot render yet)
+    if (context->splash.data) {
+        FfxRenderFunc renderFunc = context->renderFunc;
+        void *renderContext = context->context;
+        context->renderFunc = st7789_renderSplash;
+        context->context = context;
+
+        for (uint32_t y = 0; y < context->height; y += context->fragmentHeight) {
+            uint32_t rows = context->fragmentHeight;
+            if (y + rows > context->height) { rows = context->height - y; }
+            st7789_renderFragment(context, y, rows);
+        }
+        st7789_await_bus(context->bus);
+
+        context->renderFunc = renderFunc;
+        context->context = renderContext;
+    }
+
+    context->t0 = ticks();
+    context->bus->initializing = NULL;
+    context->ready = true;
+    xEventGroupSetBits(context->readyEvents, READY_BIT);
+
+    if (context->readyFunc) { context->readyFunc(context, context->readyArg); }
+
+    vTaskDelete(NULL);
+}
+
+FfxDisplayContext ffx_display_initAsync(FfxDisplaySpiBus spiBus,
+  uint8_t pinDC, uint8_t pinReset, const FfxDisplayPanel *panel,
+  FfxDisplayRotation rotation, FfxRenderFunc renderFunc,
+  void *renderContext, const FfxImage *splash, FfxDisplayReadyFunc readyFunc,
+  void *readyArg) {
+
+    _Context *context = st7789_create(spiBus, pinDC, pinReset, panel,
+      rotation, renderFunc, renderContext);
+    if (context == NULL) { return NULL; }
+
+    if (splash) { context->splash = *splash; }
+    context->readyFunc = readyFunc;
+    context->readyArg = readyArg;
+
+    context->readyEvents = xEventGroupCreate();
+    if (context->readyEvents == NULL) {
+        context->ready = true;
+        ffx_display_free(context);
+        return NULL;
+    }
+
+    // Another display attached to the bus waits for the init task
+    context->bus->initializing = context;
+
+    BaseType_t result = xTaskCreate(st7789_initTask, "ffx-display-init",
+      3072, context, uxTaskPriorityGet(NULL), NULL);
+    if (result != pdPASS) {
+        context->bus->initializing = NULL;
+        context->ready = true;
+        ffx_display_free(context);
+        return NULL;
+    }
+
+    return context;
+}
+
+bool ffx_display_isReady(FfxDisplayContext _context) {
+    _Context *context = _context;
+    return context->ready;
+}
+
+// The frame period for the pacing (in us); locked to the panel refresh
+// rate (60Hz if it has not been set) with FFX_DISPLAY_PACING_REFRESH
+static int64_t st7789_framePeriod(_Context *context) {
+    uint32_t fps = context->pacingFps;
+    if (fps == FFX_DISPLAY_PACING_REFRESH) {
+        fps = context->frameRate ? context->frameRate: 60;
+    }
+    int64_t period = 1000000 / fps;
+
+    // Halved (or less) while frames overrun (see FfxDisplayOverrunHalveRate)
+    if (context->rateDivisor > 1) { period *= context->rateDivisor; }
+
+    return period;
+}
+
+// Move a deadline to the start of the nearest panel refresh (the TE
+// edge), if the refresh can be timed; nearest rather than next, so a
+// frame period slightly longer than the refresh does not skip one
+static int64_t st7789_alignRefresh(_Context *context, int64_t deadline) {
+    int64_t vsyncTime = context->vsyncTime;
+    uint32_t lineTime = st7789_lineTime(context);
+    if (vsyncTime == 0 || lineTime == 0 || deadline <= vsyncTime) {
+        return deadline;
+    }
+
+    int64_t period = (int64_t)lineTime * context->scanLines / 1000;
+    int64_t refreshes = (deadline - vsyncTime + period / 2) / period;
+    return vsyncTime + refreshes * period;
+}
+
+// Start a frame; with frame pacing, as late as possible while still
+// completing it by its deadline, so its content is as fresh as possible.
+// Returns false (without waiting) if it is too early and not blocking.
+static bool st7789_beginFrame(_Context *context, bool blocking) {
+    int64_t now = esp_timer_get_time();
+
+    if (context->pacingFps) {
+        int64_t deadline = context->frameDeadline + st7789_framePeriod(context);
+
+        // Running late (or the first frame); start now, and pace from
+        // here, or drop the frames which cannot be made to keep to the
+        // frame times
+        if (deadline < now + context->frameDuration) {
+            int64_t period = st7789_framePeriod(context);
+            if (context->overrunPolicy == FfxDisplayOverrunDrop && context->frameDeadline) {
+                uint32_t missed = (now + context->frameDuration - deadline + period - 1) / period;
+                deadline += missed * period;
+                context->overrunStats.droppedFrames += missed;
+            } else {
+                deadline = now + context->frameDuration;
+            }
+        }
+
+        if (context->pacingFps == FFX_DISPLAY_PACING_REFRESH) {
+            deadline = st7789_alignRefresh(context, deadline);
+        }
+
+        int64_t start = deadline - context->frameDuration - PACING_MARGIN;
+        if (now < start) {
+            if (!blocking) { return false; }
+            sleepUntil(context, start);
+            now = esp_timer_get_time();
+        }
+
+        context->frameDeadline = deadline;
+    }
+
+    context->frameTime = now;
+    context->frameFragments = 0;
+    context->frameRenderTime = 0;
+    context->frameWorstCost = 0;
+    context->frameLastY = NO_FRAGMENT;
+
+    // Every fragment of the frame reads the same state
+    if (context->snapshot) { snapshot_begin(context->snapshot); }
+
+    if (context->frameBeginFunc) {
+        context->frameBeginFunc(context, context->frameBeginArg);
+    }
+
+    return true;
+}
+
+// Select the next fragment, returning its starting Y and the rows of
+// it which are displayed
+static uint32_t st7789_nextFragment(_Context *context, uint32_t *rows) {
+    context->frame++;
+
+    // Advance the fragment starting Y
+    uint32_t y0 = context->currentY;
+
+    // Start pulling in the source data for the next fragment, while this
+    // one is rendered and the previous one is on the wire
+    uint32_t spanEnd = context->spanY + context->spanHeight;
+    if (context->prefetch) {
+        uint32_t nextY = y0 + context->fragmentHeight;
+        if (nextY >= spanEnd) { nextY = context->spanY; }
+        prefetch_request(context->prefetch, nextY, y0);
+    }
+
+    // The rows of this fragment which are displayed
+    *rows = context->fragmentHeight;
+    if (y0 + *rows > spanEnd) { *rows = spanEnd - y0; }
+
+    return y0;
+}
+
+// The budget for a frame (0 for none), at the current rate
+static uint32_t st7789_frameBudget(_Context *context) {
+    if (context->frameBudget) {
+        return context->frameBudget * (context->rateDivisor ? context->rateDivisor: 1);
+    }
+    if (context->pacingFps) { return st7789_framePeriod(context); }
+    return 0;
+}
+
+// Check a completed frame against the budget, and apply the policy
+static void st7789_checkBudget(_Context *context, uint32_t duration) {
+    uint32_t budget = st7789_frameBudget(context);
+    if (budget == 0 || context->overrunPolicy == FfxDisplayOverrunNone) { return; }
+
+    FfxDisplayOverrunStats *stats = &context->overrunStats;
+    stats->frames++;
+
+    if (duration > stats->worstFrameTime) {
+        stats->worstFrameTime = duration;
+        stats->worstFrameY = context->frameWorstY;
+    }
+
+    bool overrun = (duration > budget);
+    if (overrun) {
+        stats->overruns++;
+        stats->lastOverrunFrame = context->frameNumber;
+    }
+
+    switch (context->overrunPolicy) {
+        case FfxDisplayOverrunHalveRate:
+            if (overrun) {
+                if (context->rateDivisor < MAX_RATE_DIVISOR) { context->rateDivisor *= 2; }
+                context->fitFrames = 0;
+            } else if (context->rateDivisor > 1 && duration < budget / 2) {
+                if (++context->fitFrames >= OVERRUN_RECOVERY) {
+                    context->rateDivisor /= 2;
+                    context->fitFrames = 0;
+                }
+            } else {
+                context->fitFrames = 0;
+            }
+            break;
+
+        case FfxDisplayOverrunSkipFragments:
+            // Fragments costlier than average are updated every other
+            // frame, until the frames fit in half the budget
+            if (overrun && context->skipCost == 0 && context->frameFragments) {
+                context->skipCost = context->frameRenderTime / context->frameFragments;
+            } else if (duration < budget / 2) {
+                context->skipCost = 0;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    stats->rateDivisor = context->rateDivisor;
+}
+
+// Whether the rows at y0 intersect a priority region
+static bool st7789_isPriority(_Context *context, uint32_t y0, uint32_t rows) {
+    for (int i = 0; i < MAX_PRIORITY_REGIONS; i++) {
+        _Region *region = &context->regions[i];
+        if (!region->used) { continue; }
+        if (y0 < region->y0 + region->height && region->y0 < y0 + rows) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether to leave the fragment at y0 as it is for this frame, because
+// it is outside the priority regions on an intermediate frame, or (see
+// FfxDisplayOverrunSkipFragments) it is expensive and frames overrun.
+// Never while page flipping, since the back page holds the frame before
+// last.
+static bool st7789_skipFragment(_Context *context, uint32_t y0, uint32_t rows) {
+    if (context->flipping) { return false; }
+
+    if (context->refreshDivisor > 1) {
+        if (st7789_isPriority(context, y0, rows)) { return false; }
+        if (context->frameNumber % context->refreshDivisor) { return true; }
+    }
+
+    if (context->skipCost == 0 || !(context->frameNumber & 1)) { return false; }
+
+    uint32_t index = (y0 - context->spanY) / context->fragmentHeight;
+    if (index >= context->fragmentCount) { return false; }
+    if (context->fragmentCosts[index] <= context->skipCost) { return false; }
+
+    context->overrunStats.skippedFragments++;
+    return true;
+}
+
+// Advance past the fragment, returning 1 if it completed the frame
+static uint32_t st7789_advanceFragment(_Context *context) {
+    uint32_t spanEnd = context->spanY + context->spanHeight;
+
+    context->currentY += context->fragmentHeight;
+
+    // The last fragment...
+    if (context->currentY >= spanEnd) {
+        context->currentY = context->spanY;
+        context->frameNumber++;
+
+        // The frame is presented once its last fragment sent completes
+        context->presentY = context->frameLastY;
+        context->presentFrame = context->frameNumber;
+        context->presentStart = context->frameTime;
+
+        // Track the time a frame takes, for pacing (weighted to recent)
+        uint32_t duration = esp_timer_get_time() - context->frameTime;
+        if (context->frameDuration == 0) {
+            context->frameDuration = duration;
+        } else {
+            context->frameDuration = (7 * context->frameDuration + duration) / 8;
+        }
+
+        st7789_checkBudget(context, duration);
+
+        // Reveal the band, now the whole frame has been written
+        if (context->flipping) {
+            for (_Context *display = context; display; display = display->mirror) {
+                st7789_flipPage(display);
+            }
+        }
+
+        st7789_adaptFrameRate(context, true);
+
+        // Update statistics and optionally dump them to the terminal
+        context->frameCount++;
+
+        // Update the FPS stats every 1s
         uint32_t now = ticks();
         uint32_t dt = now - context->t0;
         if (dt > 1000) {
@@ -479,3 +2381,174 @@ uint32_t ffx_display_renderFragment(FfxDisplayContext _context) {
 
     return 0;
 }
+
+// Render a fragment against the scene graph. This and the scene graph handles
+// snapshots of its state so it can be updated freely.
+uint32_t ffx_display_renderFragment(FfxDisplayContext _context) {
+
+    _Context *context = _context;
+
+    st7789_awaitReady(context);
+
+    if (context->currentY == context->spanY) { st7789_beginFrame(context, true); }
+
+    uint32_t rows;
+    uint32_t y0 = st7789_nextFragment(context, &rows);
+
+    if (!st7789_skipFragment(context, y0, rows)) {
+        context->frameFragments++;
+        context->frameLastY = y0;
+        st7789_renderFragment(context, y0, rows);
+    }
+
+    return st7789_advanceFragment(context);
+}
+
+uint32_t ffx_display_renderFrame(FfxDisplayContext _context,
+  FfxDisplayFrameInfo *info) {
+
+    _Context *context = _context;
+
+    st7789_awaitReady(context);
+
+    // With no other display on the bus, hold it for the whole frame
+    // rather than arbitrating for each transaction
+    _Bus *bus = context->bus;
+    bool acquired = (bus->refCount == 1);
+    if (acquired) {
+        st7789_await_bus(bus);
+        spi_device_acquire_bus(context->spi, portMAX_DELAY);
+    }
+
+    // Render the rest of the frame (all of it, unless a frame was
+    // partially rendered with ffx_display_renderFragment)
+    while (!ffx_display_renderFragment(context)) { }
+
+    // The last fragment is on the panel
+    st7789_await_display(context);
+    int64_t sentTime = ffx_display_presentTime(context, NULL);
+    if (sentTime == 0) { sentTime = esp_timer_get_time(); }
+
+    if (acquired) { spi_device_release_bus(context->spi); }
+
+    if (info) {
+        info->frame = context->frameNumber;
+        info->fragments = context->frameFragments;
+        info->startTime = context->frameTime;
+        info->sentTime = sentTime;
+        info->renderTime = context->frameRenderTime;
+    }
+
+    if (context->frameEndFunc) {
+        context->frameEndFunc(context, context->frameEndArg);
+    }
+
+    return context->frameNumber;
+}
+
+FfxDisplayStatus ffx_display_submitFragment(FfxDisplayContext _context) {
+    _Context *context = _context;
+    if (!context->ready) { return FfxDisplayStatusWouldBlock; }
+
+    // Both fragments are in use (one on the wire, one staged behind it)
+    _Bus *bus = context->bus;
+    st7789_poll_bus(bus);
+    if (bus->staged) { return FfxDisplayStatusWouldBlock; }
+
+    // Too early to start the next frame
+    if (context->currentY == context->spanY && !st7789_beginFrame(context, false)) {
+        return FfxDisplayStatusWouldBlock;
+    }
+
+    uint32_t rows;
+    uint32_t y0 = st7789_nextFragment(context, &rows);
+
+    if (!st7789_skipFragment(context, y0, rows)) {
+        context->frameFragments++;
+        context->frameLastY = y0;
+
+        uint8_t backbufferFragment = (bus->inflightFragment == 0) ? 1: 0;
+        st7789_render(context, bus->fragments[backbufferFragment], y0);
+
+        // Stage the fragment, and send it now if the bus is idle
+        bus->staged = context;
+        bus->stagedFragment = backbufferFragment;
+        bus->stagedY = y0;
+        bus->stagedRows = rows;
+        st7789_poll_bus(bus);
+    }
+
+    if (st7789_advanceFragment(context)) { return FfxDisplayStatusFrameDone; }
+    return FfxDisplayStatusSubmitted;
+}
+
+bool ffx_display_pollFragment(FfxDisplayContext _context) {
+    _Context *context = _context;
+    if (!context->ready) { return false; }
+    return st7789_poll_bus(context->bus);
+}
+
+int64_t ffx_display_fragmentTime(FfxDisplayContext _context, uint32_t y0) {
+    _Context *context = _context;
+    if (y0 >= context->height) { return 0; }
+    return st7789_readTime(&context->fragmentTimes[y0 / context->fragmentHeight]);
+}
+
+int64_t ffx_display_presentTime(FfxDisplayContext _context, uint32_t *frame) {
+    _Context *context = _context;
+
+    if (frame) { *frame = context->presentFrame; }
+    if (context->presentFrame == 0) { return 0; }
+
+    // Nothing was sent; the panel already showed the frame
+    if (context->presentY == NO_FRAGMENT) { return context->presentStart; }
+
+    // Still on the wire
+    int64_t time = ffx_display_fragmentTime(context, context->presentY);
+    if (time < context->presentStart) { return 0; }
+
+    return time;
+}
+
+void ffx_display_setFragmentCallback(FfxDisplayContext _context,
+  FfxDisplayFragmentFunc fragmentFunc, void *arg) {
+
+    _Context *context = _context;
+    st7789_awaitReady(context);
+
+    // Do not change the callback while the interrupt may call it
+    st7789_await_display(context);
+
+    context->fragmentFunc = fragmentFunc;
+    context->fragmentArg = arg;
+}
+
+void ffx_display_renderRows(FfxDisplayContext _context, uint32_t y0,
+  uint32_t height) {
+
+    _Context *context = _context;
+
+    st7789_awaitReady(context);
+
+    uint32_t y1 = y0 + height;
+    if (y1 > context->height) { y1 = context->height; }
+
+    for (uint32_t y = y0; y < y1; y += context->fragmentHeight) {
+        uint32_t rows = context->fragmentHeight;
+        if (y + rows > y1) { rows = y1 - y; }
+        st7789_renderFragment(context, y, rows);
+    }
+}
+
+uint32_t ffx_display_renderFragments(FfxDisplayContext *displays,
+  size_t count) {
+
+    assert(count <= 32);
+
+    uint32_t frameDone = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (ffx_display_renderFragment(displays[i])) { frameDone |= (1 << i); }
+    }
+
+    return frameDone;
+}
@@ -0,0 +1,178 @@
+/**
+ *  Image asset decoder; see firefly-image.h for the format.
+ *
+ *  This has no dependency on the display driver (or ESP-IDF), so the
+ *  same code can be used by host tools.
+ */
+
+#include <string.h>
+
+#include "firefly-image.h"
+
+
+// Native RGB565 to display pixel order (MSB first)
+#define SWAP(v)   ((uint16_t)((((v) & 0xff) << 8) | ((v) >> 8)))
+
+static uint32_t readUint16(const uint8_t *data) {
+    return data[0] | (data[1] << 8);
+}
+
+static uint32_t readUint32(const uint8_t *data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+bool ffx_image_init(FfxImage *image, const uint8_t *data, size_t length) {
+    memset(image, 0, sizeof(FfxImage));
+
+    if (length < FFX_IMAGE_HEADER_SIZE) { return false; }
+    if (memcmp(data, FFX_IMAGE_MAGIC, 4)) { return false; }
+    if (data[4] != FFX_IMAGE_VERSION) { return false; }
+
+    uint32_t width = readUint16(&data[6]);
+    uint32_t height = readUint16(&data[8]);
+    uint32_t paletteSize = readUint16(&data[10]);
+    uint32_t dataLength = readUint32(&data[12]);
+
+    const uint8_t *body = &data[FFX_IMAGE_HEADER_SIZE];
+    length -= FFX_IMAGE_HEADER_SIZE;
+
+    switch (data[5]) {
+        case FfxImageFormatRaw:
+            if (dataLength != (uint64_t)width * height * 2) { return false; }
+            break;
+
+        case FfxImageFormatPalette:
+            if (paletteSize == 0 || paletteSize > 256) { return false; }
+            if (dataLength != paletteSize * 2 + (uint64_t)width * height) { return false; }
+            image->palette = body;
+            image->paletteSize = paletteSize;
+            break;
+
+        case FfxImageFormatCompressed:
+            if (length < (size_t)height * 4) { return false; }
+            image->rowOffsets = body;
+            body += height * 4;
+            length -= height * 4;
+
+            // A bad row index would send the decoder off into the weeds
+            for (uint32_t y = 0; y < height; y++) {
+                if (readUint32(&image->rowOffsets[y * 4]) >= dataLength) {
+                    return false;
+                }
+            }
+            break;
+
+        default:
+            return false;
+    }
+
+    if (length < dataLength) { return false; }
+
+    image->format = data[5];
+    image->width = width;
+    image->height = height;
+    image->data = body;
+    image->length = dataLength;
+
+    if (image->palette) { image->data += paletteSize * 2; }
+
+    return true;
+}
+
+// Decode the first count pixels of the row starting at ops, returning
+// false if the ops run past end. The remainder of the row is skipped
+// entirely; the row index locates the next row.
+static bool decodeRow(const uint8_t *ops, const uint8_t *end,
+  uint16_t *pixels, uint32_t count) {
+    uint16_t cache[64];
+    memset(cache, 0, sizeof(cache));
+
+    uint32_t pixel = 0;     // native RGB565
+    uint16_t output = 0;    // display pixel order
+
+    while (count) {
+        if (ops == end) { return false; }
+        uint32_t op = *ops++;
+        uint32_t n = (op & 0x3f) + 1;
+
+        switch (op & FFX_IMAGE_OP_MASK) {
+            case FFX_IMAGE_OP_RUN:
+                if (n > count) { n = count; }
+                count -= n;
+                while (n--) { *pixels++ = output; }
+                break;
+
+            case FFX_IMAGE_OP_LITERAL:
+                if (n > count) { n = count; }
+                if (end - ops < 2 * n) { return false; }
+                count -= n;
+                while (n--) {
+                    pixel = (ops[0] << 8) | ops[1];
+                    ops += 2;
+                    cache[FFX_IMAGE_HASH(pixel)] = pixel;
+                    output = SWAP(pixel);
+                    *pixels++ = output;
+                }
+                break;
+
+            case FFX_IMAGE_OP_INDEX:
+                pixel = cache[op & 0x3f];
+                output = SWAP(pixel);
+                *pixels++ = output;
+                count--;
+                break;
+
+            case FFX_IMAGE_OP_DIFF: {
+                uint32_t r = ((pixel >> 11) + ((op >> 4) & 0x03) - 2) & 0x1f;
+                uint32_t g = ((pixel >> 5) + ((op >> 2) & 0x03) - 2) & 0x3f;
+                uint32_t b = (pixel + (op & 0x03) - 2) & 0x1f;
+                pixel = (r << 11) | (g << 5) | b;
+                cache[FFX_IMAGE_HASH(pixel)] = pixel;
+                output = SWAP(pixel);
+                *pixels++ = output;
+                count--;
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool ffx_image_decodeRows(const FfxImage *image, uint32_t y0,
+  uint32_t rowCount, uint16_t *pixels, uint32_t stride) {
+
+    if (y0 >= image->height) { return true; }
+    if (rowCount > image->height - y0) { rowCount = image->height - y0; }
+
+    uint32_t width = (image->width < stride) ? image->width: stride;
+
+    for (uint32_t y = y0; y < y0 + rowCount; y++) {
+        switch (image->format) {
+            case FfxImageFormatRaw:
+                memcpy(pixels, &image->data[y * image->width * 2], width * 2);
+                break;
+            case FfxImageFormatCompressed: {
+                // The row offsets are checked by ffx_image_init
+                const uint8_t *ops = &image->data[readUint32(&image->rowOffsets[y * 4])];
+                if (!decodeRow(ops, &image->data[image->length], pixels, width)) {
+                    return false;
+                }
+                break;
+            }
+            case FfxImageFormatPalette: {
+                const uint8_t *indices = &image->data[y * image->width];
+                const uint8_t *palette = image->palette;
+                for (uint32_t x = 0; x < width; x++) {
+                    if (indices[x] >= image->paletteSize) { return false; }
+                    const uint8_t *entry = &palette[indices[x] * 2];
+                    pixels[x] = entry[0] | (entry[1] << 8);
+                }
+                break;
+            }
+        }
+        pixels += stride;
+    }
+
+    return true;
+}
@@ -0,0 +1,239 @@
+/**
+ *  Fragment source prefetcher.
+ *
+ *  There are two staging slots. While the render callback reads the
+ *  slot for the current fragment, the prefetch task fills the other
+ *  slot with the data for the next fragment.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include "firefly-display.h"
+#include "prefetch.h"
+
+
+// Requests are slot indices; this one stops the task
+#define STOP_REQUEST        (0xff)
+
+// No fragment starts here
+#define NO_FRAGMENT         (0xffffffff)
+
+typedef enum SlotState {
+    SlotStateEmpty = 0,
+    SlotStatePending,
+    SlotStateReady
+} SlotState;
+
+typedef struct _Slot {
+    void *staging;
+    uint32_t y0;
+    SlotState state;
+} _Slot;
+
+typedef struct _Prefetch {
+    FfxPrefetchFunc fetchFunc;
+    void *context;
+
+    _Slot slots[2];
+
+    // Protects the slot states
+    SemaphoreHandle_t lock;
+
+    // Slot indices to fill, for the task
+    QueueHandle_t requests;
+
+    // Given each time the task finishes a slot (or stops)
+    SemaphoreHandle_t done;
+    volatile bool stopped;
+
+    FfxPrefetchStats stats;
+} _Prefetch;
+
+static void prefetchTask(void *arg) {
+    _Prefetch *prefetch = arg;
+
+    while (1) {
+        uint8_t index = STOP_REQUEST;
+        xQueueReceive(prefetch->requests, &index, portMAX_DELAY);
+        if (index == STOP_REQUEST) { break; }
+
+        _Slot *slot = &prefetch->slots[index];
+        prefetch->fetchFunc(slot->staging, slot->y0, prefetch->context);
+
+        xSemaphoreTake(prefetch->lock, portMAX_DELAY);
+        slot->state = SlotStateReady;
+        xSemaphoreGive(prefetch->lock);
+
+        xSemaphoreGive(prefetch->done);
+    }
+
+    prefetch->stopped = true;
+    xSemaphoreGive(prefetch->done);
+    vTaskDelete(NULL);
+}
+
+FfxPrefetch ffx_prefetch_init(size_t stagingSize, FfxPrefetchFunc fetchFunc,
+  void *context) {
+
+    _Prefetch *prefetch = malloc(sizeof(_Prefetch));
+    if (prefetch == NULL) { return NULL; }
+    memset(prefetch, 0, sizeof(_Prefetch));
+
+    prefetch->fetchFunc = fetchFunc;
+    prefetch->context = context;
+
+    for (int i = 0; i < 2; i++) {
+        _Slot *slot = &prefetch->slots[i];
+        slot->staging = heap_caps_malloc(stagingSize, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        slot->y0 = NO_FRAGMENT;
+        slot->state = SlotStateEmpty;
+    }
+
+    prefetch->lock = xSemaphoreCreateMutex();
+    prefetch->done = xSemaphoreCreateBinary();
+    prefetch->requests = xQueueCreate(2, sizeof(uint8_t));
+
+    if (!prefetch->slots[0].staging || !prefetch->slots[1].staging ||
+      !prefetch->lock || !prefetch->done || !prefetch->requests) {
+        goto fail;
+    }
+
+    // Run beside the render task; on the other core if there is one
+    UBaseType_t priority = uxTaskPriorityGet(NULL);
+    BaseType_t result;
+#if portNUM_PROCESSORS > 1
+    result = xTaskCreatePinnedToCore(prefetchTask, "ffx-prefetch", 2048,
+      prefetch, priority, NULL, !xPortGetCoreID());
+#else
+    result = xTaskCreate(prefetchTask, "ffx-prefetch", 2048, prefetch,
+      priority, NULL);
+#endif
+    if (result != pdPASS) { goto fail; }
+
+    return prefetch;
+
+fail:
+    if (prefetch->requests) { vQueueDelete(prefetch->requests); }
+    if (prefetch->done) { vSemaphoreDelete(prefetch->done); }
+    if (prefetch->lock) { vSemaphoreDelete(prefetch->lock); }
+    heap_caps_free(prefetch->slots[0].staging);
+    heap_caps_free(prefetch->slots[1].staging);
+    free(prefetch);
+    return NULL;
+}
+
+void ffx_prefetch_free(FfxPrefetch _prefetch) {
+    _Prefetch *prefetch = _prefetch;
+    if (!prefetch) { return; }
+
+    // Requests are handled in order, so once the task has stopped no
+    // fetch is in progress
+    uint8_t index = STOP_REQUEST;
+    xQueueSend(prefetch->requests, &index, portMAX_DELAY);
+    while (!prefetch->stopped) {
+        xSemaphoreTake(prefetch->done, portMAX_DELAY);
+    }
+
+    vQueueDelete(prefetch->requests);
+    vSemaphoreDelete(prefetch->done);
+    vSemaphoreDelete(prefetch->lock);
+    heap_caps_free(prefetch->slots[0].staging);
+    heap_caps_free(prefetch->slots[1].staging);
+    free(prefetch);
+}
+
+void prefetch_request(FfxPrefetch _prefetch, uint32_t y0, uint32_t current) {
+    _Prefetch *prefetch = _prefetch;
+
+    xSemaphoreTake(prefetch->lock, portMAX_DELAY);
+
+    // Already requested (e.g. a single-fragment display)
+    if (prefetch->slots[0].y0 == y0 || prefetch->slots[1].y0 == y0) {
+        xSemaphoreGive(prefetch->lock);
+        return;
+    }
+
+    // Never the slot the render callback is about to read from, nor
+    // one the task has yet to finish
+    uint8_t index = (prefetch->slots[0].y0 == current) ? 1: 0;
+    _Slot *slot = &prefetch->slots[index];
+    if (slot->state == SlotStatePending) {
+        xSemaphoreGive(prefetch->lock);
+        return;
+    }
+
+    slot->y0 = y0;
+    slot->state = SlotStatePending;
+
+    xSemaphoreGive(prefetch->lock);
+
+    xQueueSend(prefetch->requests, &index, portMAX_DELAY);
+}
+
+const void* ffx_prefetch_get(FfxPrefetch _prefetch, uint32_t y0) {
+    _Prefetch *prefetch = _prefetch;
+
+    xSemaphoreTake(prefetch->lock, portMAX_DELAY);
+
+    _Slot *slot = NULL;
+    for (int i = 0; i < 2; i++) {
+        if (prefetch->slots[i].y0 == y0) { slot = &prefetch->slots[i]; }
+    }
+
+    if (slot && slot->state == SlotStateReady) {
+        prefetch->stats.hits++;
+        xSemaphoreGive(prefetch->lock);
+        return slot->staging;
+    }
+
+    if (slot) {
+        prefetch->stats.waits++;
+        while (slot->state != SlotStateReady) {
+            xSemaphoreGive(prefetch->lock);
+            xSemaphoreTake(prefetch->done, portMAX_DELAY);
+            xSemaphoreTake(prefetch->lock, portMAX_DELAY);
+        }
+        xSemaphoreGive(prefetch->lock);
+        return slot->staging;
+    }
+
+    // Miss; fetch into whichever slot the task is not filling
+    prefetch->stats.misses++;
+    while (prefetch->slots[0].state == SlotStatePending &&
+      prefetch->slots[1].state == SlotStatePending) {
+        xSemaphoreGive(prefetch->lock);
+        xSemaphoreTake(prefetch->done, portMAX_DELAY);
+        xSemaphoreTake(prefetch->lock, portMAX_DELAY);
+    }
+    slot = &prefetch->slots[(prefetch->slots[0].state == SlotStatePending) ? 1: 0];
+    slot->y0 = NO_FRAGMENT;
+    slot->state = SlotStateEmpty;
+    xSemaphoreGive(prefetch->lock);
+
+    prefetch->fetchFunc(slot->staging, y0, prefetch->context);
+
+    xSemaphoreTake(prefetch->lock, portMAX_DELAY);
+    slot->y0 = y0;
+    slot->state = SlotStateReady;
+    xSemaphoreGive(prefetch->lock);
+
+    return slot->staging;
+}
+
+void ffx_prefetch_stats(FfxPrefetch _prefetch, FfxPrefetchStats *stats) {
+    _Prefetch *prefetch = _prefetch;
+    if (!prefetch) {
+        memset(stats, 0, sizeof(FfxPrefetchStats));
+        return;
+    }
+
+    xSemaphoreTake(prefetch->lock, portMAX_DELAY);
+    *stats = prefetch->stats;
+    xSemaphoreGive(prefetch->lock);
+}
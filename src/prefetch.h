@@ -0,0 +1,13 @@
+#ifndef __PREFETCH_H__
+#define __PREFETCH_H__
+
+#include <stdint.h>
+
+#include "firefly-display.h"
+
+
+// Used by the display driver; request the data for the fragment at y0
+// be prefetched, while the fragment at current is being rendered.
+void prefetch_request(FfxPrefetch prefetch, uint32_t y0, uint32_t current);
+
+#endif /* __PREFETCH_H__ */
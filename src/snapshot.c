@@ -0,0 +1,103 @@
+/**
+ *  Frame state snapshots.
+ *
+ *  There are three copies of the state. The writer fills the back copy
+ *  and publishes it by exchanging it with the latest copy, while the
+ *  render task holds the front copy for a whole frame and only swaps
+ *  it for the latest copy at the start of the next frame. As each side
+ *  only ever touches its own copy, and the exchanges are atomic, the
+ *  writer may publish any number of times during a frame without either
+ *  side taking a lock or waiting.
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "firefly-display.h"
+#include "snapshot.h"
+
+
+// Set on the latest index once it has been published and not yet taken
+#define FRESH       (0x4)
+#define INDEX_MASK  (0x3)
+
+typedef struct _Snapshot {
+    size_t size;
+    uint8_t *copies[3];
+
+    // Owned by the writer
+    uint8_t back;
+
+    // Exchanged by both; the index of the latest copy (and FRESH)
+    atomic_uint_fast8_t latest;
+
+    // Owned by the render task
+    uint8_t front;
+} _Snapshot;
+
+FfxSnapshot ffx_snapshot_init(size_t size) {
+    _Snapshot *snapshot = malloc(sizeof(_Snapshot));
+    if (snapshot == NULL) { return NULL; }
+    memset(snapshot, 0, sizeof(_Snapshot));
+
+    snapshot->size = size;
+
+    for (int i = 0; i < 3; i++) {
+        snapshot->copies[i] = calloc(1, size);
+        if (snapshot->copies[i] == NULL) {
+            ffx_snapshot_free(snapshot);
+            return NULL;
+        }
+    }
+
+    snapshot->front = 0;
+    atomic_init(&snapshot->latest, 1);
+    snapshot->back = 2;
+
+    return snapshot;
+}
+
+void ffx_snapshot_free(FfxSnapshot _snapshot) {
+    _Snapshot *snapshot = _snapshot;
+    if (!snapshot) { return; }
+
+    for (int i = 0; i < 3; i++) { free(snapshot->copies[i]); }
+    free(snapshot);
+}
+
+void* ffx_snapshot_edit(FfxSnapshot _snapshot) {
+    _Snapshot *snapshot = _snapshot;
+    return snapshot->copies[snapshot->back];
+}
+
+void ffx_snapshot_publish(FfxSnapshot _snapshot) {
+    _Snapshot *snapshot = _snapshot;
+
+    uint8_t published = snapshot->back;
+    uint8_t previous = atomic_exchange_explicit(&snapshot->latest,
+      published | FRESH, memory_order_acq_rel);
+    snapshot->back = previous & INDEX_MASK;
+
+    // Continue editing from the published state
+    memcpy(snapshot->copies[snapshot->back], snapshot->copies[published],
+      snapshot->size);
+}
+
+const void* ffx_snapshot_get(FfxSnapshot _snapshot) {
+    _Snapshot *snapshot = _snapshot;
+    return snapshot->copies[snapshot->front];
+}
+
+void snapshot_begin(FfxSnapshot _snapshot) {
+    _Snapshot *snapshot = _snapshot;
+
+    // Nothing new since the last frame; keep the current snapshot
+    if (!(atomic_load_explicit(&snapshot->latest, memory_order_acquire) & FRESH)) {
+        return;
+    }
+
+    uint8_t latest = atomic_exchange_explicit(&snapshot->latest,
+      snapshot->front, memory_order_acq_rel);
+    snapshot->front = latest & INDEX_MASK;
+}
@@ -0,0 +1,11 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include "firefly-display.h"
+
+
+// Used by the display driver; at the start of each frame, take the most
+// recently published state as the snapshot for the frame.
+void snapshot_begin(FfxSnapshot snapshot);
+
+#endif /* __SNAPSHOT_H__ */
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ffx-asset.h"
+
+
+static void writeUint16(uint8_t *data, uint32_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+}
+
+static void writeUint32(uint8_t *data, uint32_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+    data[2] = value >> 16;
+    data[3] = value >> 24;
+}
+
+// Store a native RGB565 value in display pixel order (MSB first)
+static void writePixel(uint8_t *data, uint16_t pixel) {
+    data[0] = pixel >> 8;
+    data[1] = pixel;
+}
+
+// Encode a row of pixels to ops; returns the number of bytes written.
+// This mirrors the decoder state in src/image.c exactly.
+static size_t encodeRow(const uint16_t *row, uint32_t width, uint8_t *ops) {
+    uint16_t cache[64];
+    memset(cache, 0, sizeof(cache));
+
+    uint32_t previous = 0;
+    size_t offset = 0;
+
+    // The pending LITERAL op (its op byte is filled in once the count is known)
+    size_t literalOffset = 0;
+    uint32_t literalCount = 0;
+
+    #define FLUSH_LITERAL() do { \
+        if (literalCount) { \
+            ops[literalOffset] = FFX_IMAGE_OP_LITERAL | (literalCount - 1); \
+            literalCount = 0; \
+        } \
+    } while (0)
+
+    uint32_t x = 0;
+    while (x < width) {
+        uint32_t pixel = row[x];
+
+        if (pixel == previous) {
+            uint32_t count = 0;
+            while (x < width && row[x] == previous && count < 64) {
+                count++;
+                x++;
+            }
+            FLUSH_LITERAL();
+            ops[offset++] = FFX_IMAGE_OP_RUN | (count - 1);
+            continue;
+        }
+
+        uint32_t hash = FFX_IMAGE_HASH(pixel);
+        if (cache[hash] == pixel) {
+            FLUSH_LITERAL();
+            ops[offset++] = FFX_IMAGE_OP_INDEX | hash;
+            previous = pixel;
+            x++;
+            continue;
+        }
+
+        int dr = (int)(pixel >> 11) - (int)(previous >> 11);
+        int dg = (int)((pixel >> 5) & 0x3f) - (int)((previous >> 5) & 0x3f);
+        int db = (int)(pixel & 0x1f) - (int)(previous & 0x1f);
+
+        if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+            FLUSH_LITERAL();
+            ops[offset++] = FFX_IMAGE_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2);
+
+        } else {
+            if (literalCount == 64) { FLUSH_LITERAL(); }
+            if (literalCount == 0) { literalOffset = offset++; }
+            literalCount++;
+            writePixel(&ops[offset], pixel);
+            offset += 2;
+        }
+
+        cache[hash] = pixel;
+        previous = pixel;
+        x++;
+    }
+
+    FLUSH_LITERAL();
+
+    #undef FLUSH_LITERAL
+
+    return offset;
+}
+
+int encode_asset(const Bitmap *bitmap, FfxImageFormat format, Asset *asset) {
+    uint32_t width = bitmap->width, height = bitmap->height;
+    uint32_t pixelCount = width * height;
+
+    // The index (compressed only) and data, following the header
+    uint32_t indexLength = 0, dataLength = 0, paletteSize = 0;
+
+    // Worst case for any format (a literal op per pixel plus op bytes),
+    // which must fit the 32-bit lengths of the asset
+    uint64_t maxLength = (uint64_t)height * 4 + (uint64_t)pixelCount * 3 + 512;
+    if (pixelCount == 0 || maxLength > UINT32_MAX) {
+        fprintf(stderr, "Error: unsupported image size (%ux%u)\n", width, height);
+        return -1;
+    }
+
+    uint8_t *body = malloc(maxLength);
+    if (body == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return -1;
+    }
+
+    switch (format) {
+        case FfxImageFormatRaw:
+            for (uint32_t i = 0; i < pixelCount; i++) {
+                writePixel(&body[i * 2], bitmap->pixels[i]);
+            }
+            dataLength = pixelCount * 2;
+            break;
+
+        case FfxImageFormatPalette: {
+            uint16_t palette[256];
+            uint8_t *indices = &body[512];
+            for (uint32_t i = 0; i < pixelCount; i++) {
+                uint32_t index = 0;
+                while (index < paletteSize && palette[index] != bitmap->pixels[i]) { index++; }
+                if (index == paletteSize) {
+                    if (paletteSize == 256) {
+                        fprintf(stderr, "Error: more than 256 colors; use --format compressed\n");
+                        free(body);
+                        return -1;
+                    }
+                    palette[paletteSize++] = bitmap->pixels[i];
+                }
+                indices[i] = index;
+            }
+
+            for (uint32_t i = 0; i < paletteSize; i++) {
+                writePixel(&body[i * 2], palette[i]);
+            }
+            memmove(&body[paletteSize * 2], indices, pixelCount);
+            dataLength = paletteSize * 2 + pixelCount;
+            break;
+        }
+
+        case FfxImageFormatCompressed: {
+            indexLength = height * 4;
+            uint8_t *ops = &body[indexLength];
+            for (uint32_t y = 0; y < height; y++) {
+                writeUint32(&body[y * 4], dataLength);
+                dataLength += encodeRow(&bitmap->pixels[y * width], width, &ops[dataLength]);
+            }
+            break;
+        }
+
+        default:
+            free(body);
+            return -1;
+    }
+
+    asset->length = FFX_IMAGE_HEADER_SIZE + indexLength + dataLength;
+    asset->data = malloc(asset->length);
+    if (asset->data == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        free(body);
+        return -1;
+    }
+
+    uint8_t *header = asset->data;
+    memcpy(header, FFX_IMAGE_MAGIC, 4);
+    header[4] = FFX_IMAGE_VERSION;
+    header[5] = format;
+    writeUint16(&header[6], width);
+    writeUint16(&header[8], height);
+    writeUint16(&header[10], paletteSize);
+    writeUint32(&header[12], dataLength);
+    memcpy(&asset->data[FFX_IMAGE_HEADER_SIZE], body, indexLength + dataLength);
+
+    free(body);
+
+    return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef __FFX_ASSET_H__
+#define __FFX_ASSET_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "firefly-image.h"
+
+
+// A decoded source image, as native RGB565 values
+typedef struct Bitmap {
+    uint32_t width;
+    uint32_t height;
+    uint16_t *pixels;
+} Bitmap;
+
+// An encoded asset (header included)
+typedef struct Asset {
+    uint8_t *data;
+    size_t length;
+} Asset;
+
+// Load a PNG (if built with libpng) or BMP file; returns 0 on success
+int load_bitmap(const char *filename, Bitmap *bitmap);
+
+// Encode a bitmap as an image asset; returns 0 on success
+int encode_asset(const Bitmap *bitmap, FfxImageFormat format, Asset *asset);
+
+#endif /* __FFX_ASSET_H__ */
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if HAVE_PNG
+#include <png.h>
+#endif
+
+#include "ffx-asset.h"
+
+
+// Truncate to RGB565, matching FFX_RGB565
+static uint16_t rgb565(uint32_t r, uint32_t g, uint32_t b) {
+    return ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3);
+}
+
+static uint32_t readUint16(const uint8_t *data) {
+    return data[0] | (data[1] << 8);
+}
+
+static uint32_t readUint32(const uint8_t *data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static uint8_t* readFile(const char *filename, size_t *length) {
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL) { return NULL; }
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    if (size <= 0) {
+        fclose(fp);
+        return NULL;
+    }
+
+    uint8_t *data = malloc(size);
+    if (data && fread(data, 1, size, fp) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+
+    *length = size;
+    return data;
+}
+
+// The asset header stores each dimension in 16 bits
+static int checkSize(int64_t width, int64_t height) {
+    if (width <= 0 || height <= 0 || width > 0xffff || height > 0xffff) {
+        fprintf(stderr, "Error: unsupported image size (%lldx%lld)\n",
+          (long long)width, (long long)height);
+        return -1;
+    }
+    return 0;
+}
+
+static int allocPixels(Bitmap *bitmap, uint32_t width, uint32_t height) {
+    bitmap->width = width;
+    bitmap->height = height;
+    bitmap->pixels = malloc((size_t)width * height * 2);
+    if (bitmap->pixels == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Uncompressed 24-bit and 32-bit (BGR[A]) Windows bitmaps
+static int loadBmp(const uint8_t *data, size_t length, Bitmap *bitmap) {
+    if (length < 54 || data[0] != 'B' || data[1] != 'M') { return -1; }
+
+    uint32_t offset = readUint32(&data[10]);
+    int32_t width = (int32_t)readUint32(&data[18]);
+    int32_t height = (int32_t)readUint32(&data[22]);
+    uint32_t bpp = readUint16(&data[28]);
+    uint32_t compression = readUint32(&data[30]);
+
+    // BI_RGB, or BI_BITFIELDS with the default 32-bit BGRA masks
+    if (compression != 0 && !(compression == 3 && bpp == 32)) {
+        fprintf(stderr, "Error: compressed bitmaps are not supported\n");
+        return -1;
+    }
+
+    if (bpp != 24 && bpp != 32) {
+        fprintf(stderr, "Error: unsupported bitmap depth (%d bpp)\n", bpp);
+        return -1;
+    }
+
+    // Positive heights are stored bottom-up
+    int bottomUp = (height > 0);
+    int64_t rows = bottomUp ? height: -(int64_t)height;
+    if (checkSize(width, rows)) { return -1; }
+    height = rows;
+
+    uint32_t stride = ((width * bpp / 8) + 3) & ~3;
+    if ((uint64_t)offset + (uint64_t)stride * height > length) {
+        fprintf(stderr, "Error: truncated bitmap\n");
+        return -1;
+    }
+
+    if (allocPixels(bitmap, width, height)) { return -1; }
+
+    for (int32_t y = 0; y < height; y++) {
+        const uint8_t *row = &data[offset + stride * (bottomUp ? (height - 1 - y): y)];
+        for (int32_t x = 0; x < width; x++) {
+            const uint8_t *bgr = &row[x * bpp / 8];
+            bitmap->pixels[y * width + x] = rgb565(bgr[2], bgr[1], bgr[0]);
+        }
+    }
+
+    return 0;
+}
+
+#if HAVE_PNG
+static int loadPng(const uint8_t *data, size_t length, Bitmap *bitmap) {
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+
+    if (!png_image_begin_read_from_memory(&image, data, length)) {
+        fprintf(stderr, "Error: %s\n", image.message);
+        return -1;
+    }
+
+    if (checkSize(image.width, image.height)) {
+        png_image_free(&image);
+        return -1;
+    }
+
+    // Any alpha is composited onto black
+    image.format = PNG_FORMAT_RGB;
+    uint8_t *rgb = malloc((size_t)image.width * image.height * 3);
+    if (rgb == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        png_image_free(&image);
+        return -1;
+    }
+
+    if (!png_image_finish_read(&image, NULL, rgb, 0, NULL)) {
+        fprintf(stderr, "Error: %s\n", image.message);
+        free(rgb);
+        return -1;
+    }
+
+    if (allocPixels(bitmap, image.width, image.height)) {
+        free(rgb);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < image.width * image.height; i++) {
+        bitmap->pixels[i] = rgb565(rgb[i * 3], rgb[i * 3 + 1], rgb[i * 3 + 2]);
+    }
+
+    free(rgb);
+    return 0;
+}
+#endif
+
+int load_bitmap(const char *filename, Bitmap *bitmap) {
+    size_t length = 0;
+    uint8_t *data = readFile(filename, &length);
+    if (data == NULL) {
+        fprintf(stderr, "Error: could not read %s\n", filename);
+        return -1;
+    }
+
+    int result = -1;
+    if (length >= 2 && data[0] == 'B' && data[1] == 'M') {
+        result = loadBmp(data, length, bitmap);
+
+    } else if (length >= 8 && !memcmp(data, "\x89PNG", 4)) {
+#if HAVE_PNG
+        result = loadPng(data, length, bitmap);
+#else
+        fprintf(stderr, "Error: built without libpng; convert %s to BMP\n", filename);
+#endif
+
+    } else {
+        fprintf(stderr, "Error: unknown image type: %s\n", filename);
+    }
+
+    free(data);
+    return result;
+}
@@ -0,0 +1,349 @@
+/**
+ *  ffx-asset
+ *
+ *  Converts PNG and BMP images into image assets (see firefly-image.h)
+ *  for the firefly-display pipeline, as a C header or a binary blob,
+ *  or packs several into an asset bundle (see firefly-assets.h).
+ *
+ *  Usage:
+ *    ffx-asset [--format raw|palette|compressed] [--binary]
+ *        [--name NAME] [--output FILENAME] INPUT
+ *    ffx-asset --bundle [--format FORMAT] --output FILENAME INPUT...
+ *    ffx-asset --list BUNDLE
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "firefly-assets.h"
+
+#include "ffx-asset.h"
+
+
+static const char *formatNames[] = { "raw", "compressed", "palette" };
+
+static void writeUint32(uint8_t *data, uint32_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+    data[2] = value >> 16;
+    data[3] = value >> 24;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+      "Usage: ffx-asset [OPTIONS] INPUT\n"
+      "       ffx-asset --bundle [OPTIONS] --output FILE INPUT...\n"
+      "       ffx-asset --list BUNDLE\n"
+      "\n"
+      "Converts a PNG or BMP image to a firefly-display image asset, or\n"
+      "packs several images into an asset bundle (named by basename).\n"
+      "\n"
+      "Options:\n"
+      "  --format FORMAT   raw, palette or compressed (default: compressed)\n"
+      "  --binary          write the raw asset blob instead of a C header\n"
+      "  --bundle          write an asset bundle of all INPUTs\n"
+      "  --list BUNDLE     list the contents of an asset bundle\n"
+      "  --name NAME       the C identifier (default: from INPUT)\n"
+      "  --output FILE     the output file (default: stdout)\n");
+}
+
+// Decode the asset with the device decoder and compare against the source
+static int verify(const Asset *asset, const Bitmap *bitmap) {
+    FfxImage image;
+    if (!ffx_image_init(&image, asset->data, asset->length)) { return -1; }
+
+    uint32_t width = bitmap->width;
+    uint16_t *row = malloc(width * 2);
+    if (row == NULL) { return -1; }
+
+    int result = 0;
+    for (uint32_t y = 0; y < bitmap->height && result == 0; y++) {
+        if (!ffx_image_decodeRows(&image, y, 1, row, width)) {
+            result = -1;
+            break;
+        }
+        for (uint32_t x = 0; x < width; x++) {
+            uint16_t pixel = bitmap->pixels[y * width + x];
+            if (row[x] != (uint16_t)((pixel << 8) | (pixel >> 8))) {
+                result = -1;
+                break;
+            }
+        }
+    }
+
+    free(row);
+    return result;
+}
+
+static void writeHeader(FILE *fp, const Asset *asset, const Bitmap *bitmap,
+  FfxImageFormat format, const char *name, const char *input) {
+
+    char upper[256];
+    size_t i = 0;
+    for (; name[i] && i < sizeof(upper) - 1; i++) { upper[i] = toupper(name[i]); }
+    upper[i] = 0;
+
+    fprintf(fp, "// Generated by ffx-asset from %s; do not edit.\n", input);
+    fprintf(fp, "//   - format: %s\n", formatNames[format]);
+    fprintf(fp, "//   - size:   %zu bytes (raw: %zu bytes)\n", asset->length,
+      (size_t)bitmap->width * bitmap->height * 2);
+    fprintf(fp, "//\n");
+    fprintf(fp, "// Load with ffx_image_init(&image, %s, %s_length)\n", name, name);
+    fprintf(fp, "\n");
+    fprintf(fp, "#include <stdint.h>\n");
+    fprintf(fp, "\n");
+    fprintf(fp, "#define %s_WIDTH    (%d)\n", upper, bitmap->width);
+    fprintf(fp, "#define %s_HEIGHT   (%d)\n", upper, bitmap->height);
+    fprintf(fp, "\n");
+    fprintf(fp, "const uint32_t %s_width = %d;\n", name, bitmap->width);
+    fprintf(fp, "const uint32_t %s_height = %d;\n", name, bitmap->height);
+    fprintf(fp, "const uint32_t %s_length = %zu;\n", name, asset->length);
+    fprintf(fp, "const uint8_t %s[] __attribute__((aligned(4))) = {", name);
+    for (size_t i = 0; i < asset->length; i++) {
+        fprintf(fp, "%s0x%02x,", ((i % 12) == 0) ? "\n  ": " ", asset->data[i]);
+    }
+    fprintf(fp, "\n};\n");
+}
+
+// Derive an identifier from the input basename (without extension)
+static void getName(const char *input, char *name, size_t length) {
+    const char *base = strrchr(input, '/');
+    base = base ? (base + 1): input;
+
+    size_t i = 0;
+    for (; base[i] && base[i] != '.' && i < length - 1; i++) {
+        name[i] = isalnum((int)base[i]) ? base[i]: '_';
+    }
+    name[i] = 0;
+}
+
+// Load, encode and verify an input
+static int convert(const char *input, FfxImageFormat format, Bitmap *bitmap,
+  Asset *asset) {
+
+    if (load_bitmap(input, bitmap)) { return -1; }
+    if (encode_asset(bitmap, format, asset)) { return -1; }
+
+    if (verify(asset, bitmap)) {
+        fprintf(stderr, "Error: asset failed to round-trip\n");
+        return -1;
+    }
+
+    fprintf(stderr, "%s: %dx%d %s, %zu bytes (%d%% of raw)\n", input,
+      bitmap->width, bitmap->height, formatNames[format], asset->length,
+      (int)(100 * asset->length / ((size_t)bitmap->width * bitmap->height * 2)));
+
+    return 0;
+}
+
+typedef struct BundleEntry {
+    char name[FFX_ASSETS_NAME_LENGTH];
+    Asset asset;
+} BundleEntry;
+
+static int compareEntries(const void *a, const void *b) {
+    return strcmp(((const BundleEntry*)a)->name, ((const BundleEntry*)b)->name);
+}
+
+static void freeEntries(BundleEntry *entries, int count) {
+    for (int i = 0; i < count; i++) { free(entries[i].asset.data); }
+    free(entries);
+}
+
+// Convert all the inputs, sorted by name
+static BundleEntry* loadBundle(const char **inputs, int count,
+  FfxImageFormat format) {
+
+    BundleEntry *entries = calloc(count, sizeof(BundleEntry));
+
+    for (int i = 0; i < count; i++) {
+        getName(inputs[i], entries[i].name, sizeof(entries[i].name));
+
+        Bitmap bitmap;
+        if (convert(inputs[i], format, &bitmap, &entries[i].asset)) {
+            freeEntries(entries, count);
+            return NULL;
+        }
+        free(bitmap.pixels);
+    }
+
+    // The directory is binary searched on the device
+    qsort(entries, count, sizeof(BundleEntry), compareEntries);
+    for (int i = 1; i < count; i++) {
+        if (!strcmp(entries[i - 1].name, entries[i].name)) {
+            fprintf(stderr, "Error: duplicate asset name: %s\n", entries[i].name);
+            freeEntries(entries, count);
+            return NULL;
+        }
+    }
+
+    return entries;
+}
+
+static int writeBundle(FILE *fp, BundleEntry *entries, int count) {
+
+    // Lay out the assets (4-byte aligned) after the directory
+    uint32_t offset = FFX_ASSETS_HEADER_SIZE + count * FFX_ASSETS_ENTRY_SIZE;
+    uint8_t *directory = calloc(1, offset);
+    for (int i = 0; i < count; i++) {
+        uint8_t *entry = &directory[FFX_ASSETS_HEADER_SIZE + i * FFX_ASSETS_ENTRY_SIZE];
+        memcpy(entry, entries[i].name, strlen(entries[i].name));
+        offset = (offset + 3) & ~3;
+        writeUint32(&entry[FFX_ASSETS_NAME_LENGTH], offset);
+        writeUint32(&entry[FFX_ASSETS_NAME_LENGTH + 4], entries[i].asset.length);
+        offset += entries[i].asset.length;
+    }
+
+    memcpy(directory, FFX_ASSETS_MAGIC, 4);
+    directory[4] = FFX_ASSETS_VERSION;
+    directory[6] = count;
+    directory[7] = count >> 8;
+    writeUint32(&directory[8], offset);
+
+    size_t written = fwrite(directory, 1, FFX_ASSETS_HEADER_SIZE + count * FFX_ASSETS_ENTRY_SIZE, fp);
+    for (int i = 0; i < count; i++) {
+        static const uint8_t padding[4] = { 0 };
+        written += fwrite(padding, 1, ((written + 3) & ~3) - written, fp);
+        written += fwrite(entries[i].asset.data, 1, entries[i].asset.length, fp);
+    }
+
+    free(directory);
+
+    fprintf(stderr, "bundle: %d assets, %zu bytes\n", count, written);
+
+    return 0;
+}
+
+// List a bundle, using the same lookup code the device uses
+static int listBundle(const char *filename) {
+    FfxAssets assets = ffx_assets_open(filename);
+    if (assets == NULL) {
+        fprintf(stderr, "Error: not a valid asset bundle: %s\n", filename);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < ffx_assets_count(assets); i++) {
+        const char *name = ffx_assets_name(assets, i);
+
+        size_t length = 0;
+        ffx_assets_find(assets, name, &length);
+
+        FfxImage image;
+        if (ffx_assets_findImage(assets, name, &image)) {
+            printf("%-24s %6zu bytes  %dx%d %s\n", name, length, image.width,
+              image.height, formatNames[image.format]);
+        } else {
+            printf("%-24s %6zu bytes  (not an image)\n", name, length);
+        }
+    }
+
+    ffx_assets_close(assets);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    FfxImageFormat format = FfxImageFormatCompressed;
+    int binary = 0, bundle = 0;
+    const char *name = NULL;
+    const char *output = NULL;
+
+    const char **inputs = calloc(argc, sizeof(char*));
+    int inputCount = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (!strcmp(arg, "--binary")) {
+            binary = 1;
+
+        } else if (!strcmp(arg, "--bundle")) {
+            bundle = 1;
+
+        } else if (!strcmp(arg, "--list") && i + 1 < argc) {
+            return listBundle(argv[i + 1]) ? 1: 0;
+
+        } else if (!strcmp(arg, "--format") && i + 1 < argc) {
+            const char *value = argv[++i];
+            if (!strcmp(value, "raw")) {
+                format = FfxImageFormatRaw;
+            } else if (!strcmp(value, "palette")) {
+                format = FfxImageFormatPalette;
+            } else if (!strcmp(value, "compressed")) {
+                format = FfxImageFormatCompressed;
+            } else {
+                fprintf(stderr, "Error: unknown format: %s\n", value);
+                return 1;
+            }
+
+        } else if (!strcmp(arg, "--name") && i + 1 < argc) {
+            name = argv[++i];
+
+        } else if (!strcmp(arg, "--output") && i + 1 < argc) {
+            output = argv[++i];
+
+        } else if (arg[0] == '-') {
+            usage();
+            return 1;
+
+        } else {
+            inputs[inputCount++] = arg;
+        }
+    }
+
+    if (inputCount == 0 || (!bundle && inputCount > 1) || (bundle && !output)) {
+        usage();
+        return 1;
+    }
+
+    // Convert everything before opening (and truncating) the output, so
+    // a failed conversion leaves any existing output as it was
+    BundleEntry *entries = NULL;
+    Bitmap bitmap;
+    Asset asset;
+    if (bundle) {
+        entries = loadBundle(inputs, inputCount, format);
+        if (entries == NULL) { return 1; }
+    } else if (convert(inputs[0], format, &bitmap, &asset)) {
+        return 1;
+    }
+
+    FILE *fp = output ? fopen(output, (binary || bundle) ? "wb": "w"): stdout;
+    if (fp == NULL) {
+        fprintf(stderr, "Error: could not write %s\n", output);
+        return 1;
+    }
+
+    int result = 0;
+    if (bundle) {
+        result = writeBundle(fp, entries, inputCount);
+        freeEntries(entries, inputCount);
+
+    } else {
+        char defaultName[256];
+        if (name == NULL) {
+            getName(inputs[0], defaultName, sizeof(defaultName));
+            name = defaultName;
+        }
+
+        if (binary) {
+            fwrite(asset.data, 1, asset.length, fp);
+        } else {
+            writeHeader(fp, &asset, &bitmap, format, name, inputs[0]);
+        }
+    }
+
+    if (ferror(fp)) {
+        fprintf(stderr, "Error: could not write %s\n", output ? output: "stdout");
+        result = -1;
+    }
+
+    // Do not leave a partial output behind
+    if (output) {
+        fclose(fp);
+        if (result) { remove(output); }
+    }
+
+    return result ? 1: 0;
+}